@@ -0,0 +1,538 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+#include "econ.h"
+#include "worldgen.h"
+
+FILE* _log;
+
+
+
+enum {
+	SCN_PRODUCTION = 0,
+	SCN_CHAINS,
+	SCN_MARKET,
+	SCN_LOAD,
+	SCN_MAXVALUE,
+};
+
+static char* g_ScenarioNames[] = {
+	[SCN_PRODUCTION] = "production",
+	[SCN_CHAINS] = "chains",
+	[SCN_MARKET] = "market",
+	[SCN_LOAD] = "load",
+};
+
+
+typedef struct BenchResult {
+	int ok;
+	long entities;
+	long ticks;
+
+	double loadMs;
+	double bytesPerEntity;
+
+	// per-tick latency, microseconds
+	double mean, p50, p90, p99, max;
+	double ticksPerSec;
+
+	// the market clearing phase alone, microseconds
+	double clearP50, clearP99;
+} BenchResult;
+
+
+typedef struct BenchOpts {
+	char* tmplPath;
+	char* baselinePath;
+	char* writeBaseline;
+	long ticks;
+	double budget; // seconds of ticking per scenario
+	double threshold; // allowed slowdown before flagging, 0.1 = 10%
+	uint64_t seed;
+} BenchOpts;
+
+
+
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long rss_bytes(void) {
+	long pages = 0, rss = 0;
+
+	FILE* f = fopen("/proc/self/statm", "r");
+	if(!f) return 0;
+	if(fscanf(f, "%ld %ld", &pages, &rss) != 2) rss = 0;
+	fclose(f);
+
+	return rss * sysconf(_SC_PAGESIZE);
+}
+
+static int cmp_double(const void* a, const void* b) {
+	double x = *(double*)a, y = *(double*)b;
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(double* sorted, long n, double p) {
+	if(n <= 0) return 0;
+	long i = p * (n - 1) + 0.5;
+	return sorted[MIN(i, n - 1)];
+}
+
+
+
+
+static void scenario_opts(int scn, long size, uint64_t seed, WorldGenOpts* o) {
+	WorldGen_DefaultOpts(o);
+
+	o->seed = seed;
+	o->forests = 0;
+	o->camps = 0;
+	o->sinks = 0;
+	o->mines = 0;
+	o->people = 0;
+
+	switch(scn) {
+		case SCN_PRODUCTION:
+			o->mines = size;
+			break;
+
+		case SCN_CHAINS:
+			o->forests = MAX(1, size / 10);
+			o->camps = size - o->forests;
+			break;
+
+		case SCN_MARKET:
+		case SCN_LOAD:
+			o->forests = MAX(1, size / 20);
+			o->camps = size * 3 / 4;
+			o->sinks = MAX(1, size / 1000);
+			o->people = size - o->forests - o->camps;
+			break;
+	}
+}
+
+
+static long count_entities(Economy* ec) {
+	long n = 0;
+	VECMP_EACH(&ec->entityDefs, i, ed) {
+		n += VEC_LEN(&ed->instances);
+	}
+	return n;
+}
+
+
+// runs in a forked child so every scenario starts from a clean heap
+static void run_scenario(int scn, char* worldPath, BenchOpts* bo, BenchResult* r) {
+	memset(r, 0, sizeof(*r));
+
+	long rss0 = rss_bytes();
+	double t0 = now_sec();
+
+	Economy ec;
+	Economy_init(&ec);
+	if(Economy_LoadConfig(&ec, worldPath)) return;
+
+	double t1 = now_sec();
+	long rss1 = rss_bytes();
+
+	r->entities = count_entities(&ec);
+	r->loadMs = (t1 - t0) * 1000.0;
+	r->bytesPerEntity = r->entities ? (double)(rss1 - rss0) / r->entities : 0;
+	r->ok = 1;
+
+	if(scn == SCN_LOAD) return;
+
+	double* lat = malloc(sizeof(*lat) * bo->ticks);
+	double* clr = malloc(sizeof(*clr) * bo->ticks);
+	double start = now_sec();
+
+	long n;
+	for(n = 0; n < bo->ticks; n++) {
+		double a = now_sec();
+		Economy_tick(&ec);
+		double b = now_sec();
+
+		lat[n] = (b - a) * 1e6;
+		clr[n] = ec.clearSec * 1e6;
+
+		if(b - start > bo->budget) {
+			n++;
+			break;
+		}
+	}
+
+	double total = now_sec() - start;
+
+	qsort(lat, n, sizeof(*lat), cmp_double);
+	qsort(clr, n, sizeof(*clr), cmp_double);
+
+	double sum = 0;
+	for(long i = 0; i < n; i++) sum += lat[i];
+
+	r->ticks = n;
+	r->mean = n ? sum / n : 0;
+	r->p50 = percentile(lat, n, 0.50);
+	r->p90 = percentile(lat, n, 0.90);
+	r->p99 = percentile(lat, n, 0.99);
+	r->max = n ? lat[n - 1] : 0;
+	r->ticksPerSec = total > 0 ? n / total : 0;
+	r->clearP50 = percentile(clr, n, 0.50);
+	r->clearP99 = percentile(clr, n, 0.99);
+
+	free(lat);
+	free(clr);
+}
+
+
+static int run_forked(int scn, char* worldPath, BenchOpts* bo, BenchResult* r) {
+	int fds[2];
+	if(pipe(fds)) return 1;
+
+	pid_t pid = fork();
+	if(pid == 0) {
+		close(fds[0]);
+
+		BenchResult cr;
+		run_scenario(scn, worldPath, bo, &cr);
+
+		ssize_t w = write(fds[1], &cr, sizeof(cr));
+		_exit(w == sizeof(cr) ? 0 : 1);
+	}
+
+	close(fds[1]);
+
+	memset(r, 0, sizeof(*r));
+	ssize_t got = read(fds[0], r, sizeof(*r));
+	close(fds[0]);
+
+	waitpid(pid, NULL, 0);
+
+	return got != sizeof(*r) || !r->ok;
+}
+
+
+
+
+// ensemble sweep: every member runs the market world with each sink's
+//   maxBuyPrice scaled by its own factor
+typedef struct SweepResult {
+	double scale;
+	int64_t consumed; // units bought by sinks
+	long volume; // units traded between entities
+	money_t vwap; // over the whole run, all items
+} SweepResult;
+
+
+static double sweep_scale(int member, int members) {
+	return members > 1 ? 0.5 + (double)member / (members - 1) : 1.0;
+}
+
+static void sweep_setup(Economy* ec, int member, void* arg) {
+	int members = *(int*)arg;
+	double scale = sweep_scale(member, members);
+
+	VEC_EACH(&ec->markets, mi, m) {
+		VECMP_EACH(&m->sinks, i, sink) {
+			sink->maxBuyPrice = MAX(1, sink->maxBuyPrice * scale);
+		}
+	}
+}
+
+static void sweep_result(Economy* ec, int member, void* out, void* arg) {
+	SweepResult* r = out;
+	CommodityTotals* ct = &ec->totals;
+	money_t value = 0;
+
+	r->scale = sweep_scale(member, *(int*)arg);
+
+	VEC_EACH(&ct->items, i, item) {
+		r->consumed += Totals_Get(ct, item, TOT_CONSUMED);
+
+		ItemTradeStats* st = Trades_Stats(&ec->trades, item);
+		if(!st) continue;
+		r->volume += st->volume;
+		value += st->value;
+	}
+
+	r->vwap = r->volume ? value / r->volume : 0;
+}
+
+
+static int run_sweep(Economy* tmpl, BenchOpts* bo, long size, int members) {
+	WorldGenOpts o;
+	scenario_opts(SCN_MARKET, size, bo->seed, &o);
+
+	char path[256];
+	snprintf(path, sizeof(path), "/tmp/econbench-sweep-%ld-%lu.json", size, (unsigned long)bo->seed);
+	if(WorldGen_WritePath(tmpl, &o, path)) {
+		fprintf(stderr, "Failed to generate world for the sweep\n");
+		return 1;
+	}
+
+	Economy ec;
+	Economy_init(&ec);
+	int err = Economy_LoadConfig(&ec, path);
+	unlink(path);
+	if(err) return 1;
+
+	Ensemble en = {
+		.members = members,
+		.ticks = bo->ticks,
+		.resultSize = sizeof(SweepResult),
+	};
+
+	double t0 = now_sec();
+	int failed = Econ_RunEnsemble(&ec, &en, sweep_setup, sweep_result, &members);
+	double t1 = now_sec();
+
+	if(failed < 0) return 1;
+
+	printf("%-6s %8s %12s %12s %9s\n", "member", "scale", "consumed", "volume", "vwap");
+
+	int ok = 0;
+	double sumC = 0, sumP = 0;
+	int64_t minC = INT64_MAX, maxC = 0;
+	for(int k = 0; k < members; k++) {
+		SweepResult* r = Ensemble_Result(&en, k);
+		if(en.status[k] != ENS_DONE) {
+			printf("%-6d FAILED\n", k);
+			continue;
+		}
+
+		printf("%-6d %8.2f %12ld %12ld %9ld\n", k, r->scale, (long)r->consumed, r->volume, (long)r->vwap);
+
+		ok++;
+		sumC += r->consumed;
+		sumP += r->vwap;
+		minC = MIN(minC, r->consumed);
+		maxC = MAX(maxC, r->consumed);
+	}
+
+	if(ok) {
+		printf("%d/%d members, %ld ticks each, %.2fs: consumed mean %.1f min %ld max %ld, vwap mean %.1f\n",
+			ok, members, (long)bo->ticks, t1 - t0, sumC / ok, (long)minC, (long)maxC, sumP / ok);
+	}
+
+	Ensemble_Free(&en);
+
+	return failed > 0;
+}
+
+
+
+
+// baseline file format, one metric per line:
+//   <scenario> <size> <metric> <value>
+typedef struct BaselineEntry {
+	char scenario[32];
+	long size;
+	char metric[32];
+	double value;
+} BaselineEntry;
+
+static VEC(BaselineEntry) g_baseline;
+
+
+static void load_baseline(char* path) {
+	VEC_INIT(&g_baseline);
+
+	FILE* f = fopen(path, "r");
+	if(!f) return;
+
+	BaselineEntry b;
+	while(4 == fscanf(f, "%31s %ld %31s %lf", b.scenario, &b.size, b.metric, &b.value)) {
+		VEC_PUSH(&g_baseline, b);
+	}
+
+	fclose(f);
+}
+
+static BaselineEntry* find_baseline(char* scenario, long size, char* metric) {
+	VEC_EACHP(&g_baseline, i, b) {
+		if(b->size == size && 0 == strcmp(b->scenario, scenario) && 0 == strcmp(b->metric, metric)) return b;
+	}
+	return NULL;
+}
+
+
+// returns 1 if the value regressed past the threshold
+static int check_metric(FILE* out, char* scenario, long size, char* metric, double value, double threshold) {
+	if(out) fprintf(out, "%s %ld %s %f\n", scenario, size, metric, value);
+
+	BaselineEntry* b = find_baseline(scenario, size, metric);
+	if(!b || b->value <= 0) return 0;
+
+	double change = (value - b->value) / b->value;
+	if(change <= threshold) return 0;
+
+	printf("  REGRESSION %s/%ld %s: %.2f -> %.2f (+%.1f%%)\n",
+		scenario, size, metric, b->value, value, change * 100.0);
+
+	return 1;
+}
+
+
+
+
+static void usage(void) {
+	fprintf(stderr,
+		"usage: econbench [options] [scenario...]\n"
+		"  scenarios: production chains market load (all)\n"
+		"  -t path   template world (defs.json)\n"
+		"  -n list   comma separated entity counts (1000,100000,1000000)\n"
+		"  -i n      ticks per scenario (200)\n"
+		"  -b secs   max seconds of ticking per scenario (20)\n"
+		"  -B path   baseline to compare against (bench_baseline.txt)\n"
+		"  -w path   write this run's numbers as a new baseline\n"
+		"  -r pct    allowed regression in percent (10)\n"
+		"  -s n      world seed (1)\n"
+		"  -e n      instead of the scenarios, run n copies of the market world at\n"
+		"            the first size, sweeping sink prices from 0.5x to 1.5x\n"
+	);
+}
+
+
+int main(int argc, char* argv[]) {
+	BenchOpts bo = {
+		.tmplPath = "defs.json",
+		.baselinePath = "bench_baseline.txt",
+		.writeBaseline = NULL,
+		.ticks = 200,
+		.budget = 20,
+		.threshold = 0.10,
+		.seed = 1,
+	};
+
+	long sizes[16] = {1000, 100000, 1000000};
+	int sizeCnt = 3;
+	int sweep = 0;
+
+	int opt;
+	while((opt = getopt(argc, argv, "t:n:i:b:B:w:r:s:e:")) != -1) {
+		switch(opt) {
+			case 't': bo.tmplPath = optarg; break;
+			case 'i': bo.ticks = MAX(1, atol(optarg)); break;
+			case 'b': bo.budget = atof(optarg); break;
+			case 'B': bo.baselinePath = optarg; break;
+			case 'w': bo.writeBaseline = optarg; break;
+			case 'r': bo.threshold = atof(optarg) / 100.0; break;
+			case 's': bo.seed = strtoull(optarg, NULL, 10); break;
+			case 'e': sweep = MAX(1, atoi(optarg)); break;
+			case 'n': {
+				sizeCnt = 0;
+				char* s = optarg;
+				while(*s && sizeCnt < 16) {
+					sizes[sizeCnt++] = strtol(s, &s, 10);
+					if(*s == ',') s++;
+				}
+				break;
+			}
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	int enabled[SCN_MAXVALUE] = {0};
+	int any = 0;
+	for(int i = optind; i < argc; i++) {
+		for(int s = 0; s < SCN_MAXVALUE; s++) {
+			if(0 == strcmp(argv[i], g_ScenarioNames[s])) enabled[s] = any = 1;
+		}
+	}
+	if(!any) {
+		for(int s = 0; s < SCN_MAXVALUE; s++) enabled[s] = 1;
+	}
+
+	_log = fopen("/dev/null", "w");
+
+	Economy tmpl;
+	Economy_init(&tmpl);
+	if(Economy_LoadConfig(&tmpl, bo.tmplPath)) {
+		fprintf(stderr, "Failed to load template '%s'\n", bo.tmplPath);
+		return 1;
+	}
+
+	// the template only feeds the world generator
+	Publisher_Close(tmpl.publisher);
+	tmpl.publisher = NULL;
+
+	if(sweep) return run_sweep(&tmpl, &bo, sizes[0], sweep);
+
+	load_baseline(bo.baselinePath);
+
+	FILE* wb = NULL;
+	if(bo.writeBaseline) {
+		wb = fopen(bo.writeBaseline, "w");
+		if(!wb) {
+			fprintf(stderr, "Could not write baseline '%s'\n", bo.writeBaseline);
+			return 1;
+		}
+	}
+
+	printf("%-10s %8s %9s %6s %9s %9s %9s %9s %9s %10s %9s %8s %9s %9s\n",
+		"scenario", "size", "entities", "ticks", "mean_us", "p50_us", "p90_us", "p99_us", "max_us", "ticks/s", "load_ms", "B/ent", "clr50_us", "clr99_us");
+
+	int regressions = 0;
+
+	for(int z = 0; z < sizeCnt; z++) {
+		for(int s = 0; s < SCN_MAXVALUE; s++) {
+			if(!enabled[s]) continue;
+
+			char* name = g_ScenarioNames[s];
+
+			WorldGenOpts o;
+			scenario_opts(s, sizes[z], bo.seed, &o);
+
+			char path[256];
+			snprintf(path, sizeof(path), "/tmp/econbench-%s-%ld-%lu.json", name, sizes[z], (unsigned long)bo.seed);
+			if(WorldGen_WritePath(&tmpl, &o, path)) {
+				fprintf(stderr, "Failed to generate world for %s/%ld\n", name, sizes[z]);
+				continue;
+			}
+
+			BenchResult r;
+			if(run_forked(s, path, &bo, &r)) {
+				printf("%-10s %8ld FAILED\n", name, sizes[z]);
+				unlink(path);
+				continue;
+			}
+
+			unlink(path);
+
+			printf("%-10s %8ld %9ld %6ld %9.1f %9.1f %9.1f %9.1f %9.1f %10.1f %9.1f %8.0f %9.1f %9.1f\n",
+				name, sizes[z], r.entities, r.ticks, r.mean, r.p50, r.p90, r.p99, r.max,
+				r.ticksPerSec, r.loadMs, r.bytesPerEntity, r.clearP50, r.clearP99
+			);
+			fflush(stdout);
+
+			regressions += check_metric(wb, name, sizes[z], "load_ms", r.loadMs, bo.threshold);
+			regressions += check_metric(wb, name, sizes[z], "bytes_per_entity", r.bytesPerEntity, bo.threshold);
+			if(s != SCN_LOAD) {
+				regressions += check_metric(wb, name, sizes[z], "p50_us", r.p50, bo.threshold);
+				regressions += check_metric(wb, name, sizes[z], "p99_us", r.p99, bo.threshold);
+			}
+			if(s == SCN_MARKET) {
+				regressions += check_metric(wb, name, sizes[z], "clear_p50_us", r.clearP50, bo.threshold);
+				regressions += check_metric(wb, name, sizes[z], "clear_p99_us", r.clearP99, bo.threshold);
+			}
+		}
+	}
+
+	if(wb) fclose(wb);
+
+	if(regressions) {
+		printf("%d regression(s) against %s\n", regressions, bo.baselinePath);
+		return 2;
+	}
+
+	return 0;
+}
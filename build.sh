@@ -1,10 +1,8 @@
 #!/bin/bash
 
 
-gcc \
-	-o econsim \
+CFLAGS="\
 	-ggdb -O0 \
-	-lncurses -ltinfo -lm \
 	-DSTI_C3DLAS_NO_CONFLICT \
 	-Wall -Werror=all \
 	-Wno-unused-function \
@@ -15,9 +13,42 @@ gcc \
 	-Wno-unused-variable \
 	-Wno-discarded-qualifiers \
 	-Werror=int-conversion -Werror=implicit-function-declaration \
-	-Werror=incompatible-pointer-types \
+	-Werror=incompatible-pointer-types"
+
+SOURCES="\
 	sti/sti.c c_json/json.c \
-	main.c econ.c entity.c comp.c conv.c market.c
-	
+	econ.c entity.c comp.c conv.c market.c cmd.c spatial.c roads.c ship.c ledger.c cashflow.c totals.c pool.c markets.c trades.c ensemble.c publish.c query.c items.c"
+
+
+# ./build.sh bench  -- optimized benchmark binary only
+if [ "$1" == "bench" ]; then
+	gcc \
+		-o econbench \
+		-lm -lpthread -lrt \
+		${CFLAGS/-O0/-O2} \
+		$SOURCES worldgen.c bench.c
 	
+	exit $?
+fi
+
+
+gcc \
+	-o econsim \
+	-lncurses -ltinfo -lm -lpthread -lrt \
+	$CFLAGS \
+	$SOURCES main.c sim.c
+
+gcc \
+	-o genworld \
+	-lm -lpthread -lrt \
+	$CFLAGS \
+	$SOURCES worldgen.c genworld.c
+
+gcc \
+	-o shmdump \
+	-lrt \
+	$CFLAGS \
+	shmdump.c
+
+
 
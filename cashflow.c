@@ -0,0 +1,315 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "econ.h"
+
+
+
+
+void CashflowBook_Init(CashflowBook* cb) {
+	VEC_INIT(&cb->flows);
+	VEC_INIT(&cb->freeFlows);
+	VEC_INIT(&cb->schedules);
+	
+	for(int i = 0; i < CASHFLOW_WHEEL; i++) {
+		VEC_INIT(&cb->ring[i]);
+	}
+	VEC_INIT(&cb->far);
+	VEC_INIT(&cb->byEntity);
+	
+	cb->live = 0;
+}
+
+
+void CashflowBook_Destroy(CashflowBook* cb) {
+	VEC_EACHP(&cb->flows, i, r) {
+		free(r->desc);
+	}
+	
+	VEC_EACHP(&cb->schedules, i, s) {
+		for(tick_t p = 0; p < s->frequency; p++) {
+			VEC_FREE(&s->buckets[p]);
+		}
+		free(s->buckets);
+	}
+	
+	for(int i = 0; i < CASHFLOW_WHEEL; i++) {
+		VEC_FREE(&cb->ring[i]);
+	}
+	VEC_FREE(&cb->far);
+	
+	VEC_EACHP(&cb->byEntity, i, l) {
+		VEC_FREE(l);
+	}
+	VEC_FREE(&cb->byEntity);
+	
+	VEC_FREE(&cb->flows);
+	VEC_FREE(&cb->freeFlows);
+	VEC_FREE(&cb->schedules);
+}
+
+
+// there are only ever a handful of distinct frequencies
+// returns -1 if the schedule could not be allocated
+static int64_t get_schedule(CashflowBook* cb, tick_t frequency) {
+	VEC_EACHP(&cb->schedules, i, s) {
+		if(s->frequency == frequency) return i;
+	}
+	
+	CashflowSchedule s = {
+		.frequency = frequency,
+	};
+	
+	s.buckets = calloc(1, sizeof(*s.buckets) * frequency);
+	if(!s.buckets) {
+		LOG("Cashflows: could not allocate a schedule for frequency %lu", (unsigned long)frequency);
+		return -1;
+	}
+	
+	VEC_PUSH(&cb->schedules, s);
+	
+	return VEC_LEN(&cb->schedules) - 1;
+}
+
+
+// files a long flow under its due tick
+static void place_long(CashflowBook* cb, uint32_t h, tick_t now) {
+	CashflowRec* r = &VEC_ITEM(&cb->flows, h);
+	
+	if(r->due - now < CASHFLOW_WHEEL) {
+		CashflowList* slot = &cb->ring[r->due & (CASHFLOW_WHEEL - 1)];
+		r->far = 0;
+		r->pos = VEC_LEN(slot);
+		VEC_PUSH(slot, h);
+	}
+	else {
+		r->far = 1;
+		r->pos = VEC_LEN(&cb->far);
+		VEC_PUSH(&cb->far, h);
+	}
+}
+
+
+static void party_link(CashflowBook* cb, econid_t eid, uint32_t h, uint32_t* pos) {
+	while(VEC_LEN(&cb->byEntity) <= eid) {
+		VEC_INC(&cb->byEntity);
+		VEC_INIT(&VEC_TAIL(&cb->byEntity));
+	}
+	
+	CashflowList* l = &VEC_ITEM(&cb->byEntity, eid);
+	*pos = VEC_LEN(l);
+	VEC_PUSH(l, h);
+}
+
+
+// swap-removes, fixing up whichever side of the moved flow sat at the tail
+static void party_unlink(CashflowBook* cb, econid_t eid, uint32_t pos) {
+	CashflowList* l = &VEC_ITEM(&cb->byEntity, eid);
+	uint32_t tail = VEC_LEN(l) - 1;
+	
+	CashflowRec* m = &VEC_ITEM(&cb->flows, VEC_TAIL(l));
+	if(m->f.from == eid && m->fromPos == tail) m->fromPos = pos;
+	else m->toPos = pos;
+	
+	VEC_ITEM(l, pos) = VEC_TAIL(l);
+	VEC_LEN(l)--;
+}
+
+
+// both parties must be existing entity slots, since flows are indexed by them
+static econid_t add_flow(CashflowBook* cb, tick_t now, econid_t slots, EcCashflow* f, char* desc) {
+	if(f->frequency == 0 || f->amount <= 0) return 0;
+	if(f->from >= slots || f->to >= slots) return 0;
+	
+	int64_t si = CASHFLOW_LONG;
+	if(f->frequency <= CASHFLOW_WHEEL) {
+		si = get_schedule(cb, f->frequency);
+		if(si < 0) return 0;
+	}
+	
+	uint32_t h;
+	uint8_t gen = 0;
+	if(VEC_LEN(&cb->freeFlows)) {
+		h = VEC_TAIL(&cb->freeFlows);
+		gen = VEC_ITEM(&cb->flows, h).gen;
+		VEC_LEN(&cb->freeFlows)--;
+	}
+	else {
+		if(VEC_LEN(&cb->flows) >= CASHFLOW_MAXFLOWS) {
+			LOG("Cashflows: too many flows");
+			return 0;
+		}
+		
+		h = VEC_LEN(&cb->flows);
+		VEC_INC(&cb->flows);
+	}
+	
+	CashflowRec* r = &VEC_ITEM(&cb->flows, h);
+	*r = (CashflowRec){
+		.f = *f,
+		.sched = si,
+		.desc = desc ? strdup(desc) : NULL,
+		.live = 1,
+		.gen = gen,
+	};
+	
+	// first payment one full period from now
+	if(si == CASHFLOW_LONG) {
+		r->due = now + f->frequency;
+		place_long(cb, h, now);
+	}
+	else {
+		CashflowSchedule* s = &VEC_ITEM(&cb->schedules, si);
+		r->due = now % f->frequency;
+		r->pos = VEC_LEN(&s->buckets[r->due]);
+		VEC_PUSH(&s->buckets[r->due], h);
+		s->count++;
+	}
+	
+	party_link(cb, f->from, h, &r->fromPos);
+	party_link(cb, f->to, h, &r->toPos);
+	
+	cb->live++;
+	
+	return ((econid_t)gen << CASHFLOW_GEN_SHIFT) | (h + 1);
+}
+
+
+static void cancel_handle(CashflowBook* cb, uint32_t h) {
+	CashflowRec* r = &VEC_ITEM(&cb->flows, h);
+	
+	CashflowList* list;
+	if(r->sched == CASHFLOW_LONG) {
+		list = r->far ? &cb->far : &cb->ring[r->due & (CASHFLOW_WHEEL - 1)];
+	}
+	else {
+		CashflowSchedule* s = &VEC_ITEM(&cb->schedules, r->sched);
+		list = &s->buckets[r->due];
+		s->count--;
+	}
+	
+	// swap-remove, fixing up the moved flow's position
+	uint32_t last = VEC_TAIL(list);
+	VEC_ITEM(list, r->pos) = last;
+	VEC_ITEM(&cb->flows, last).pos = r->pos;
+	VEC_LEN(list)--;
+	
+	party_unlink(cb, r->f.from, r->fromPos);
+	party_unlink(cb, r->f.to, r->toPos);
+	
+	free(r->desc);
+	r->desc = NULL;
+	r->live = 0;
+	r->gen++;
+	
+	cb->live--;
+	VEC_PUSH(&cb->freeFlows, h);
+}
+
+
+static void cancel_flow(CashflowBook* cb, econid_t id) {
+	uint32_t idx = id & CASHFLOW_MAXFLOWS;
+	if(idx == 0 || idx > VEC_LEN(&cb->flows)) return;
+	
+	CashflowRec* r = &VEC_ITEM(&cb->flows, idx - 1);
+	if(!r->live || r->gen != id >> CASHFLOW_GEN_SHIFT) return;
+	
+	cancel_handle(cb, idx - 1);
+}
+
+
+
+
+// returns the flow's id, 0 if it was invalid
+econid_t Economy_AddCashflow(Economy* ec, money_t amount, econid_t from, econid_t to, uint32_t freq, char* desc) {
+	EcCashflow f = {
+		.from = from,
+		.to = to,
+		.amount = amount,
+		.frequency = freq,
+	};
+	
+	return add_flow(&ec->cashflows, ec->tick, ec->entitySlots, &f, desc);
+}
+
+
+// ids may be NULL; invalid flows get id 0
+void Econ_AddCashflows(Economy* ec, EcCashflow* flows, long count, econid_t* ids) {
+	for(long i = 0; i < count; i++) {
+		econid_t id = add_flow(&ec->cashflows, ec->tick, ec->entitySlots, &flows[i], NULL);
+		if(ids) ids[i] = id;
+	}
+}
+
+
+void Econ_CancelCashflow(Economy* ec, econid_t id) {
+	cancel_flow(&ec->cashflows, id);
+}
+
+void Econ_CancelCashflows(Economy* ec, econid_t* ids, long count) {
+	for(long i = 0; i < count; i++) {
+		cancel_flow(&ec->cashflows, ids[i]);
+	}
+}
+
+// drops every flow the entity pays or receives
+void Econ_CancelEntityCashflows(Economy* ec, econid_t eid) {
+	CashflowBook* cb = &ec->cashflows;
+	if(eid >= VEC_LEN(&cb->byEntity)) return;
+	
+	CashflowList* l = &VEC_ITEM(&cb->byEntity, eid);
+	while(VEC_LEN(l)) {
+		cancel_handle(cb, VEC_TAIL(l));
+	}
+}
+
+
+// posts every flow due this tick to the ledger
+// returns the number posted
+long Econ_RunCashflows(Economy* ec) {
+	CashflowBook* cb = &ec->cashflows;
+	tick_t now = ec->tick;
+	long n = 0;
+	
+	VEC_EACHP(&cb->schedules, i, s) {
+		if(!s->count) continue;
+		
+		VEC_EACH(&s->buckets[now % s->frequency], j, h) {
+			CashflowRec* r = &VEC_ITEM(&cb->flows, h);
+			Ledger_Post(&ec->ledger, r->f.from, r->f.to, r->f.amount);
+			n++;
+		}
+	}
+	
+	// pull the next revolution's long flows in from the far list
+	if((now & (CASHFLOW_WHEEL - 1)) == 0) {
+		for(intptr_t i = 0; i < VEC_LEN(&cb->far); i++) {
+			uint32_t h = VEC_ITEM(&cb->far, i);
+			if(VEC_ITEM(&cb->flows, h).due - now >= CASHFLOW_WHEEL) continue;
+			
+			uint32_t last = VEC_TAIL(&cb->far);
+			VEC_ITEM(&cb->far, i) = last;
+			VEC_ITEM(&cb->flows, last).pos = i;
+			VEC_LEN(&cb->far)--;
+			
+			place_long(cb, h, now);
+			i--; // retry this index
+		}
+	}
+	
+	// a long flow's next payment is more than a revolution out, so
+	//   rescheduling never lands back in this slot
+	CashflowList* slot = &cb->ring[now & (CASHFLOW_WHEEL - 1)];
+	VEC_EACH(slot, j, h) {
+		CashflowRec* r = &VEC_ITEM(&cb->flows, h);
+		Ledger_Post(&ec->ledger, r->f.from, r->f.to, r->f.amount);
+		n++;
+		
+		r->due += r->f.frequency;
+		place_long(cb, h, now);
+	}
+	VEC_TRUNC(slot);
+	
+	return n;
+}
@@ -0,0 +1,73 @@
+
+
+// recurring payments: wages, rents, loan installments
+//   flows are grouped by frequency, and within a frequency by phase, so a
+//   tick only visits the flows due on it
+//   frequencies beyond CASHFLOW_WHEEL are kept by due tick instead, in a
+//   ring of the next CASHFLOW_WHEEL ticks plus a far list swept once per
+//   revolution, the same way shipments are
+
+
+
+typedef struct CashflowRec {
+	EcCashflow f;
+	tick_t due; // short flows: the phase, tick % frequency; long flows: the next due tick
+	uint32_t sched; // index into schedules, CASHFLOW_LONG for long flows
+	uint32_t pos; // index in its bucket, ring slot or the far list
+	uint32_t fromPos, toPos; // index in the parties' byEntity lists
+	char* desc;
+	char live;
+	char far;
+	uint8_t gen; // bumped on cancel, so stale ids miss
+} CashflowRec;
+
+
+#define CASHFLOW_WHEEL 1024
+#define CASHFLOW_LONG UINT32_MAX
+
+// ids carry the handle + 1 in the low bits and the slot's generation above
+#define CASHFLOW_GEN_SHIFT 24
+#define CASHFLOW_MAXFLOWS ((1ul << CASHFLOW_GEN_SHIFT) - 1)
+
+typedef VEC(uint32_t) CashflowList; // flow handles
+
+typedef struct CashflowSchedule {
+	tick_t frequency; // at most CASHFLOW_WHEEL
+	CashflowList* buckets; // by phase
+	long count;
+} CashflowSchedule;
+
+
+typedef struct CashflowBook {
+	VEC(CashflowRec) flows;
+	VEC(uint32_t) freeFlows;
+	
+	VEC(CashflowSchedule) schedules;
+	
+	// slot i holds long flows due on ticks t where t % CASHFLOW_WHEEL == i,
+	//   for t less than CASHFLOW_WHEEL ticks ahead
+	CashflowList ring[CASHFLOW_WHEEL];
+	
+	// long flows due beyond the ring, moved in once per revolution
+	CashflowList far;
+	
+	// flows each entity pays or receives, by entity id
+	VEC(CashflowList) byEntity;
+	
+	long live;
+} CashflowBook;
+
+
+
+
+void CashflowBook_Init(CashflowBook* cb);
+void CashflowBook_Destroy(CashflowBook* cb);
+
+struct Economy;
+econid_t Economy_AddCashflow(struct Economy* ec, money_t amount, econid_t from, econid_t to, uint32_t freq, char* desc);
+void Econ_AddCashflows(struct Economy* ec, EcCashflow* flows, long count, econid_t* ids);
+void Econ_CancelCashflow(struct Economy* ec, econid_t id);
+void Econ_CancelCashflows(struct Economy* ec, econid_t* ids, long count);
+void Econ_CancelEntityCashflows(struct Economy* ec, econid_t eid);
+long Econ_RunCashflows(struct Economy* ec);
+
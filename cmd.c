@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "econ.h"
+
+
+
+
+void CmdBuffer_Init(CmdBuffer* cb) {
+	VEC_INIT(&cb->cmds);
+}
+
+void CmdBuffer_Destroy(CmdBuffer* cb) {
+	VEC_FREE(&cb->cmds);
+}
+
+
+
+// the id is valid immediately; the entity exists after the next Cmd_Apply
+econid_t Cmd_Create(Economy* ec, CmdBuffer* cb, int type) {
+	econid_t id = Econ_ReserveID(ec);
+
+	VEC_PUSH(&cb->cmds, ((EntityCmd){
+		.cmd = CMD_CREATE,
+		.eid = id,
+		.type = type,
+	}));
+
+	return id;
+}
+
+// ids may be NULL
+void Cmd_CreateN(Economy* ec, CmdBuffer* cb, int type, long count, econid_t* ids) {
+	for(long i = 0; i < count; i++) {
+		econid_t id = Cmd_Create(ec, cb, type);
+		if(ids) ids[i] = id;
+	}
+}
+
+
+void Cmd_Destroy(CmdBuffer* cb, econid_t eid) {
+	VEC_PUSH(&cb->cmds, ((EntityCmd){
+		.cmd = CMD_DESTROY,
+		.eid = eid,
+	}));
+}
+
+void Cmd_DestroyN(CmdBuffer* cb, econid_t* ids, long count) {
+	for(long i = 0; i < count; i++) {
+		Cmd_Destroy(cb, ids[i]);
+	}
+}
+
+
+// the command takes ownership of anything value points to
+void Cmd_AddComp(CmdBuffer* cb, econid_t eid, int compType, Comp* value) {
+	EntityCmd c = {
+		.cmd = CMD_ADDCOMP,
+		.eid = eid,
+		.type = compType,
+	};
+
+	if(value) c.value = *value;
+	c.value.type = compType;
+
+	VEC_PUSH(&cb->cmds, c);
+}
+
+void Cmd_RemoveComp(CmdBuffer* cb, econid_t eid, int compType) {
+	VEC_PUSH(&cb->cmds, ((EntityCmd){
+		.cmd = CMD_REMOVECOMP,
+		.eid = eid,
+		.type = compType,
+	}));
+}
+
+
+
+
+static int road_comp_type(Economy* ec, int compType) {
+	CompDef* cd = Econ_GetCompDef(ec, compType);
+	if(!cd) return 0;
+	
+	return cd->type == CT_roadspan || cd->type == CT_roadconnect ? cd->type : 0;
+}
+
+
+// applies every command in order, then empties the buffer
+// must run between ticks, with no other thread reserving ids
+void Cmd_Apply(Economy* ec, CmdBuffer* cb) {
+	long destroyed = 0;
+
+	VEC_EACHP(&cb->cmds, i, c) {
+		Entity* e = NULL;
+
+		if(c->cmd != CMD_CREATE) {
+			if(c->eid >= ec->entitySlots) continue;
+			e = Econ_GetEntity(ec, c->eid);
+		}
+
+		switch(c->cmd) {
+			case CMD_CREATE:
+				e = Econ_InitEntity(ec, c->eid, c->type, "");
+				Econ_SpatialUpdate(ec, e);
+				Econ_LedgerReset(ec, e);
+				break;
+
+			case CMD_DESTROY:
+				if(e->dead) break;
+				VEC_EACHP(&e->comps, j, cp) {
+					if(road_comp_type(ec, cp->type)) ec->roadGraph.dirty = 1;
+				}
+				Econ_DestroyEntity(ec, e);
+				Econ_SpatialUpdate(ec, e);
+				Econ_LedgerReset(ec, e);
+				Econ_CancelEntityCashflows(ec, e->id);
+				destroyed++;
+				break;
+
+			case CMD_ADDCOMP: {
+				if(e->dead) {
+					Comp_Free(ec, &c->value);
+					break;
+				}
+
+				Comp* old = Entity_GetComp(e, c->type);
+				int replaced = old != NULL;
+				if(old) Comp_Free(ec, old);
+				else old = Entity_AddComp(e, c->type);
+
+				*old = c->value;
+				Econ_SpatialUpdate(ec, e);
+				if(c->type == ec->cashComp) Econ_LedgerReset(ec, e);
+				if(c->type == ec->storageVolumeComp || c->type == ec->storageWeightComp) Econ_StorageUpdate(ec, e);
+
+				// roads can be added incrementally, but not changed
+				int rt = road_comp_type(ec, c->type);
+				if(rt && replaced) ec->roadGraph.dirty = 1;
+				else if(rt) Econ_RoadAdded(ec, e, rt);
+				break;
+			}
+
+			case CMD_REMOVECOMP:
+				if(e->dead) break;
+				Entity_RemoveComp(ec, e, c->type);
+				Econ_SpatialUpdate(ec, e);
+				if(c->type == ec->storageVolumeComp || c->type == ec->storageWeightComp) Econ_StorageUpdate(ec, e);
+				if(road_comp_type(ec, c->type)) ec->roadGraph.dirty = 1;
+				break;
+		}
+	}
+
+	VEC_TRUNC(&cb->cmds);
+
+	// orders point at their sellers directly
+	if(destroyed) {
+		VEC_EACH(&ec->markets, mi, m) {
+			Market_RemoveDeadSellers(m);
+		}
+	}
+
+	Econ_FlushFreeIDs(ec);
+	Econ_CompactCompArrays(ec);
+}
@@ -0,0 +1,41 @@
+
+
+struct Economy;
+
+
+enum EntityCmdType {
+	CMD_NONE = 0,
+	CMD_CREATE,
+	CMD_DESTROY,
+	CMD_ADDCOMP,
+	CMD_REMOVECOMP,
+};
+
+
+typedef struct EntityCmd {
+	unsigned char cmd;
+	econid_t eid; // reserved up front for creates
+	int type; // entity type for creates, component type otherwise
+	Comp value; // for CMD_ADDCOMP; pointer values are owned by the command
+} EntityCmd;
+
+
+// structural changes recorded during a tick and applied at the tick boundary
+typedef struct CmdBuffer {
+	VEC(EntityCmd) cmds;
+} CmdBuffer;
+
+
+
+
+void CmdBuffer_Init(CmdBuffer* cb);
+void CmdBuffer_Destroy(CmdBuffer* cb);
+
+econid_t Cmd_Create(struct Economy* ec, CmdBuffer* cb, int type);
+void Cmd_CreateN(struct Economy* ec, CmdBuffer* cb, int type, long count, econid_t* ids);
+void Cmd_Destroy(CmdBuffer* cb, econid_t eid);
+void Cmd_DestroyN(CmdBuffer* cb, econid_t* ids, long count);
+void Cmd_AddComp(CmdBuffer* cb, econid_t eid, int compType, Comp* value);
+void Cmd_RemoveComp(CmdBuffer* cb, econid_t eid, int compType);
+
+void Cmd_Apply(struct Economy* ec, CmdBuffer* cb);
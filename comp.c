@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 
 
 #include "econ.h"
@@ -68,11 +69,12 @@ int Econ_CompTypeFromName(Economy* ec, char* compName) {
 
 
 Comp* Entity_SetCompName(Economy* ec, Entity* e, char* compName, ...) {
-	int ctype = CompInternalTypeFromName(compName);
+	int ctype = Econ_CompTypeFromName(ec, compName);
+	if(ctype < 0) return NULL;
 	
 	va_list va;
 	va_start(va, compName);
-	Comp* c = Entity_SetComp(ec, e, ctype, va);
+	Comp* c = Entity_SetComp_va(ec, e, ctype, va);
 	va_end(va);
 	
 	return c;
@@ -81,38 +83,79 @@ Comp* Entity_SetCompName(Economy* ec, Entity* e, char* compName, ...) {
 Comp* Entity_SetComp(Economy* ec, Entity* e, int ctype, ...) {
 	va_list va;
 	va_start(va, ctype);
-	Comp* c = Entity_SetComp(ec, e, ctype, va);
+	Comp* c = Entity_SetComp_va(ec, e, ctype, va);
 	va_end(va);
 	
 	return c;
 }
 
+// for callers that only know the type at runtime; systems use the typed
+//   Entity_Get_x/Set_x/Elems_x accessors
 Comp* Entity_SetComp_va(Economy* ec, Entity* e, int ctype, va_list va) {
-	Comp* c = Entity_AssertComp(e, ctype);
+	void* p = Entity_CompForWrite(ec, e, ctype);
 	
-	// TODO: support arrays
-	CompDef* cd = Econ_GetCompDef(ec, ctype);
-	
-	if(cd->isPtr && !c->vp) {
-		c->vp = calloc(1, InternalCompTypeSize(cd->type));
-	}
-	
-	switch(cd->type) {
+	switch(Econ_GetCompDef(ec, ctype)->type) {
 		default:
-			fprintf(stderr, "unknown component type: %d\n", cd->type);
+			fprintf(stderr, "unknown component type: %d\n", ctype);
 			exit(1);
 			
-		case CT_int: c->n = va_arg(va, int64_t); break;
-		case CT_float: c->d = va_arg(va, double); break;
-		case CT_str: c->str = strdup(va_arg(va, char*)); break;
-		case CT_id: c->id = va_arg(va, econid_t); break;
-		case CT_itemRate: *c->itemRate = va_arg(va, ItemRate); break;
+		case CT_int: *(int64_t*)p = va_arg(va, int64_t); break;
+		case CT_float: *(double*)p = va_arg(va, double); break;
+		case CT_str: *(char**)p = strdup(va_arg(va, char*)); break;
+		case CT_id: *(econid_t*)p = va_arg(va, econid_t); break;
+		case CT_itemRate: *(ItemRate*)p = va_arg(va, ItemRate); break;
+		case CT_itemPrice: *(ItemPrice*)p = va_arg(va, ItemPrice); break;
+		case CT_conversion: *(ConvertRate*)p = va_arg(va, ConvertRate); break;
+		case CT_roadspan: *(RoadSpan*)p = va_arg(va, RoadSpan); break;
+		case CT_roadconnect: *(RoadConnect*)p = va_arg(va, RoadConnect); break;
+		case CT_point: *(EcPoint*)p = va_arg(va, EcPoint); break;
 	}
 	
-	return c;
+	return Entity_GetComp(e, ctype);
 } 
 
 
+// the comp's value, ready to be overwritten: created if missing and not
+//   shared with a prototype. arrays are cut to a single element
+void* Entity_CompForWrite(Economy* ec, Entity* e, int compType) {
+	Comp* c = Entity_AssertComp(e, compType);
+	CompDef* cd = Econ_GetCompDef(ec, compType);
+	
+	if(cd->isArray) {
+		return Comp_ArrayResize(cd, c, 1);
+	}
+	
+	if(cd->type == CT_str) {
+		if(!(c->flags & COMPF_SHARED)) free(c->str);
+		c->str = NULL;
+		c->flags &= ~COMPF_SHARED;
+		return &c->str;
+	}
+	
+	if(cd->isPtr) {
+		if(!c->vp) c->vp = calloc(1, InternalCompTypeSize(cd->type));
+		else Comp_Unshare(ec, c);
+		return c->vp;
+	}
+	
+	return &c->vp;
+}
+
+
+
+// debug check behind the typed accessors; types below 0 are comps the
+//   world doesn't define, and read as absent
+void Econ_CompCheck(Economy* ec, int compType, int internalType, int allowArray, const char* fn) {
+	if(compType < 0) return;
+	
+	CompDef* cd = Econ_GetCompDef(ec, compType);
+	if(cd->type == internalType && (allowArray || !cd->isArray)) return;
+	
+	fprintf(stderr, "%s: component '%s' is %s%s\n", fn, cd->name,
+		cd->isArray ? "an array of " : "", CompInternalType_GetName(cd->type));
+	abort();
+}
+
 
 CompDef* Economy_NewCompDef(Economy* ec) {
 	CompDef* cd;
@@ -128,14 +171,6 @@ CompDef* Economy_NewCompDef(Economy* ec) {
 
 
 
-Comp* Entity_GetComp(Entity* e, int compType) {
-	VEC_EACHP(&e->comps, i, cp) {
-		if(cp->type == compType) return cp;
-	}
-	
-	return NULL;
-}
-
 Comp* Entity_GetCompName(Economy* ec, Entity* e, char* compName) {
 	int type = Econ_CompTypeFromName(ec, compName);
 	if(type < 0) return NULL;
@@ -143,11 +178,6 @@ Comp* Entity_GetCompName(Economy* ec, Entity* e, char* compName) {
 }
 
 
-Comp* Entity_SetCompInt(Entity* e, int compType, int64_t val) {
-	
-	return NULL;
-}
-
 // return value is only valid temporarily
 Comp* Entity_AddComp(Entity* e, int compType) {
 	Comp* c;
@@ -155,6 +185,7 @@ Comp* Entity_AddComp(Entity* e, int compType) {
 	VEC_INC(&e->comps);
 	c = &VEC_TAIL(&e->comps);
 	
+	memset(c, 0, sizeof(*c));
 	c->type = compType;
 	
 	return c;
@@ -173,6 +204,194 @@ Comp* Entity_AssertComp(Entity* e, int compType) {
 }
 
 
+// gives the component its own copy of a value shared with a prototype
+void Comp_Unshare(Economy* ec, Comp* c) {
+	if(!(c->flags & COMPF_SHARED)) return;
+	
+	CompDef* cd = Econ_GetCompDef(ec, c->type);
+	if(cd->isArray) {
+		Comp_ArrayResize(cd, c, c->length);
+	}
+	else if(cd->type == CT_str) {
+		c->str = c->str ? strdup(c->str) : NULL;
+	}
+	else {
+		size_t sz = InternalCompTypeSize(cd->type);
+		void* p = malloc(sz);
+		memcpy(p, c->vp, sz);
+		c->vp = p;
+	}
+	
+	c->flags &= ~COMPF_SHARED;
+}
+
+
+// releases whatever the component owns; the slot itself is left alone
+void Comp_Free(Economy* ec, Comp* c) {
+	if(c->flags & COMPF_SHARED) return;
+	
+	CompDef* cd = Econ_GetCompDef(ec, c->type);
+	if(cd->isArray) {
+		cd->arr.garbage += c->alloc;
+		c->arrOff = 0;
+		c->length = 0;
+		c->alloc = 0;
+	}
+	else if(cd->isPtr || cd->type == CT_str) {
+		free(c->vp);
+		c->vp = NULL;
+	}
+}
+
+
+// the component's value, or its elements for arrays
+void* Comp_Data(Economy* ec, Comp* c, int* count) {
+	CompDef* cd = Econ_GetCompDef(ec, c->type);
+	
+	if(cd->isArray) {
+		if(count) *count = c->length;
+		return Comp_ArrayData(cd, c);
+	}
+	
+	if(count) *count = 1;
+	return cd->isPtr ? c->vp : &c->vp;
+}
+
+
+// an int or float comp read as a number, whichever the def declares
+// arrays give their first element; def for anything else or missing
+double Econ_CompNumber(Economy* ec, Entity* e, int compType, double def) {
+	Comp* c = compType >= 0 ? Entity_GetComp(e, compType) : NULL;
+	if(!c) return def;
+	
+	CompDef* cd = Econ_GetCompDef(ec, compType);
+	if(cd->type != CT_int && cd->type != CT_float) return def;
+	if(cd->isArray && !c->length) return def;
+	
+	QueryCol col = {QCOL_COMP, compType};
+	return Query_ColumnValue(ec, e, &col);
+}
+
+
+// array elements live packed in one buffer per def; a comp owns the
+//   range [arrOff, arrOff + alloc) unless it is shared with a prototype
+static uint32_t array_alloc(CompDef* cd, uint32_t n) {
+	if(cd->arr.len + n > cd->arr.alloc) {
+		cd->arr.alloc = MAX(MAX(64, cd->arr.alloc * 2), cd->arr.len + n);
+		cd->arr.data = realloc(cd->arr.data, cd->arr.alloc * cd->arr.elemSize);
+	}
+	
+	uint32_t off = cd->arr.len;
+	cd->arr.len += n;
+	return off;
+}
+
+
+// sets the element count, moving the range when it is shared or full;
+//   new elements are zeroed. returns the elements
+void* Comp_ArrayResize(CompDef* cd, Comp* c, int count) {
+	size_t esz = cd->arr.elemSize;
+	
+	if(count > USHRT_MAX) {
+		LOG("Array component '%s' is limited to %d elements", cd->name, USHRT_MAX);
+		count = USHRT_MAX;
+	}
+	
+	if((c->flags & COMPF_SHARED) || count > c->alloc) {
+		int cap = count;
+		if(!(c->flags & COMPF_SHARED) && c->alloc) cap = MIN(USHRT_MAX, MAX(count, c->alloc * 2));
+		
+		uint32_t off = array_alloc(cd, cap);
+		memcpy(cd->arr.data + off * esz, cd->arr.data + (size_t)c->arrOff * esz, MIN(count, c->length) * esz);
+		
+		if(!(c->flags & COMPF_SHARED)) cd->arr.garbage += c->alloc;
+		
+		c->arrOff = off;
+		c->alloc = cap;
+		c->flags &= ~COMPF_SHARED;
+	}
+	
+	if(count > c->length) {
+		memset(cd->arr.data + ((size_t)c->arrOff + c->length) * esz, 0, (count - c->length) * esz);
+	}
+	
+	c->length = count;
+	return Comp_ArrayData(cd, c);
+}
+
+
+static void compact_comp(CompDef* cd, Comp* c, uint32_t* moved, char* data, uint32_t* len) {
+	if(c->type != cd->id) return;
+	
+	if(!c->alloc) {
+		c->arrOff = 0;
+		return;
+	}
+	
+	// ranges shared with a prototype are moved once
+	if(moved[c->arrOff] == UINT32_MAX) {
+		memcpy(data + (size_t)*len * cd->arr.elemSize, Comp_ArrayData(cd, c), c->alloc * cd->arr.elemSize);
+		moved[c->arrOff] = *len;
+		*len += c->alloc;
+	}
+	
+	c->arrOff = moved[c->arrOff];
+}
+
+
+// repacks array storage once most of it is garbage; must run between ticks
+void Econ_CompactCompArrays(Economy* ec) {
+	VECMP_EACH(&ec->compDefs, i, cd) {
+		if(!cd->isArray || cd->arr.garbage < 1024 || cd->arr.garbage * 2 < cd->arr.len) continue;
+		
+		uint32_t* moved = malloc(cd->arr.len * sizeof(*moved));
+		memset(moved, 0xff, cd->arr.len * sizeof(*moved));
+		
+		uint32_t len = 0;
+		uint32_t alloc = MAX(64, cd->arr.len - cd->arr.garbage);
+		char* data = malloc(alloc * cd->arr.elemSize);
+		
+		if(cd->def) compact_comp(cd, cd->def, moved, data, &len);
+		
+		VECMP_EACH(&ec->entityDefs, j, ed) {
+			VEC_EACHP(&ed->defaultComps, k, dc) {
+				if(dc->hasLocalDefault) compact_comp(cd, &dc->localDefault, moved, data, &len);
+			}
+			for(int k = 0; k < ed->protoCnt; k++) {
+				compact_comp(cd, &ed->proto[k], moved, data, &len);
+			}
+		}
+		
+		VECMP_EACH(&ec->entities, j, e) {
+			if(e->dead) continue;
+			VEC_EACHP(&e->comps, k, c) {
+				compact_comp(cd, c, moved, data, &len);
+			}
+		}
+		
+		free(moved);
+		free(cd->arr.data);
+		
+		cd->arr.data = data;
+		cd->arr.len = len;
+		cd->arr.alloc = alloc;
+		cd->arr.garbage = 0;
+	}
+}
+
+
+void Entity_RemoveComp(Economy* ec, Entity* e, int compType) {
+	VEC_EACHP(&e->comps, i, cp) {
+		if(cp->type != compType) continue;
+		
+		Comp_Free(ec, cp);
+		*cp = VEC_TAIL(&e->comps);
+		VEC_LEN(&e->comps)--;
+		return;
+	}
+}
+
+
 size_t InternalCompTypeSize(int internalType) {
 	return g_CompTypeSizes[internalType];
 }
@@ -44,11 +44,7 @@ long Conv_DoConversion(Conversion* conv, Inventory* inv, long count) {
 	
 	// subtract inputs
 	for(int i = 0; i < conv->inputCnt; i++) {
-		InvItem* item = Inv_GetItemP(inv, conv->inputs[i].item);
-		if(item) {
-			long n = conv->inputs[i].count * count;
-			item->count = MAX(0, item->count - n);
-		}
+		Inv_AddItem(inv, conv->inputs[i].item, -conv->inputs[i].count * count);
 	}
 	
 	// add outputs
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 
 #include "econ.h"
@@ -28,6 +29,212 @@ static char g_CompTypeIsPtr[] = {
 
 
 
+// entity id references are done through string aliases
+// a lookup table of actual id's is used by a list of
+//   reference locations to match strings to id's 
+//   without regard to declaration order 
+typedef struct LoaderState {
+	Economy* ec;
+	HT(econid_t) nameLookup;
+	HT(Conversion*) conversionLookup;
+	VEC(struct fixes {char* name; econid_t* target;}) fixes;
+	VEC(struct invDefer {econid_t eid; char* name; long count;}) invDefer;
+	VEC(struct convDefer {char* name; Conversion** target;}) convDefer;
+	
+	// inline id components move when their entity's comp list grows,
+	//   so they are found again by entity and component type
+	VEC(struct compFix {char* name; econid_t eid; int compType;}) compFixes;
+	
+	// array storage can move while loading, so references inside
+	//   elements are kept as an element index and a byte offset
+	VEC(struct arrFix {char* name; int compType; uint32_t elem; size_t offset; char isConv;}) arrFixes;
+} LoaderState;
+
+
+
+// a string is deferred as an entity reference, anything else is a literal id
+static void load_id(LoaderState* ls, json_value_t* v, econid_t* target) {
+	if(v->type == JSON_TYPE_STRING) {
+		LOG("Deferring '%s' at line %d", v->s, __LINE__);
+		VEC_PUSH(&ls->fixes, ((struct fixes){v->s, target}));
+	}
+	else {
+		*target = json_as_int(v);
+	}
+}
+
+
+static void load_comp_array(LoaderState* ls, CompDef* cd, Comp* c, econid_t eid, json_value_t* j_cval);
+
+
+// reads a component value into c
+// eid is the owning entity, or 0 when parsing defaults
+static void load_comp_value(LoaderState* ls, CompDef* cd, Comp* c, econid_t eid, json_value_t* j_cval) {
+	
+	if(cd->isArray) {
+		load_comp_array(ls, cd, c, eid, j_cval);
+		return;
+	}
+	
+	if(cd->isPtr) {
+		c->vp = calloc(1, InternalCompTypeSize(cd->type));
+		c->flags &= ~COMPF_SHARED;
+	}
+	
+	// defaults may be plain numbers for structured types
+	if(cd->isPtr && j_cval->type != JSON_TYPE_ARRAY) return;
+	
+	switch(cd->type) {
+		default:
+			LOG("unknown component type: %d", cd->type);
+			exit(1);
+		
+		case CT_float: c->d = json_as_double(j_cval); break;
+		
+		case CT_int: c->n = json_as_int(j_cval); break;
+		
+		case CT_str: 
+			c->str = j_cval->type == JSON_TYPE_STRING ? strdup(j_cval->s) : NULL;
+			c->flags &= ~COMPF_SHARED;
+			break;
+		
+		case CT_id: 
+			if(j_cval->type != JSON_TYPE_STRING) {
+				c->id = json_as_int(j_cval);
+			}
+			else if(eid) {
+				VEC_PUSH(&ls->compFixes, ((struct compFix){j_cval->s, eid, cd->id}));
+			}
+			else {
+				LOG("Entity references are not supported in defaults: '%s'", j_cval->s);
+			}
+			break;
+			
+		case CT_itemRate:
+			load_id(ls, j_cval->arr.head->v, &c->itemRate->item);
+			c->itemRate->rate = json_as_float(j_cval->arr.head->next->v);
+			break;
+		
+		case CT_itemPrice:
+			load_id(ls, j_cval->arr.head->v, &c->itemPrice->item);
+			c->itemPrice->price = json_as_int(j_cval->arr.head->next->v);
+			break;
+		
+		case CT_conversion:
+			c->convertRate->acc = 0;
+			c->convertRate->rate = json_as_float(j_cval->arr.head->v);
+			LOG("Deferring '%s' at line %d", j_cval->arr.head->next->v->s, __LINE__);
+			VEC_PUSH(&ls->convDefer, ((struct convDefer){j_cval->arr.head->next->v->s, &c->convertRate->c}));		
+			break;
+			
+		case CT_roadspan:
+			c->roadSpan->a.x = json_as_float(j_cval->arr.head->v);
+			c->roadSpan->a.y = json_as_float(j_cval->arr.head->next->v);
+			c->roadSpan->b.x = json_as_float(j_cval->arr.head->next->next->v);
+			c->roadSpan->b.y = json_as_float(j_cval->arr.head->next->next->next->v);
+			break;
+		
+		case CT_roadconnect:
+			load_id(ls, j_cval->arr.head->v, &c->roadConnect->to);
+			c->roadConnect->where.x = json_as_float(j_cval->arr.head->next->v);
+			c->roadConnect->where.y = json_as_float(j_cval->arr.head->next->next->v);
+			break;	
+		
+		case CT_point:
+			if(j_cval->type != JSON_TYPE_ARRAY || j_cval->len < 2) break;
+			c->point.x = json_as_float(j_cval->arr.head->v);
+			c->point.y = json_as_float(j_cval->arr.head->next->v);
+			break;
+	}
+}
+
+
+
+// an array value is a list of elements or a single element;
+//   a plain number as a default means empty
+static void load_comp_array(LoaderState* ls, CompDef* cd, Comp* c, econid_t eid, json_value_t* j_cval) {
+	
+	// each element is parsed as a plain value of the element type
+	CompDef elem = *cd;
+	elem.isArray = 0;
+	elem.isPtr = g_CompTypeIsPtr[cd->type];
+	
+	int elemIsArray = elem.isPtr || cd->type == CT_point;
+	int isList = j_cval->type == JSON_TYPE_ARRAY 
+		&& (!elemIsArray || (j_cval->len && j_cval->arr.head->v->type == JSON_TYPE_ARRAY));
+	
+	int n = isList ? j_cval->len : (eid || j_cval->type == JSON_TYPE_ARRAY);
+	
+	// drop whatever range the comp had, shared or not
+	Comp_Free(ls->ec, c);
+	c->flags &= ~COMPF_SHARED;
+	c->length = c->alloc = 0;
+	
+	char* data = Comp_ArrayResize(cd, c, n);
+	
+	json_link_t* link = isList ? j_cval->arr.head : NULL;
+	for(int k = 0; k < n; k++) {
+		json_value_t* v = isList ? link->v : j_cval;
+		Comp tmp = {.type = cd->id};
+		
+		size_t fixCnt = VEC_LEN(&ls->fixes);
+		size_t convCnt = VEC_LEN(&ls->convDefer);
+		
+		if(cd->type == CT_id && v->type == JSON_TYPE_STRING) {
+			VEC_PUSH(&ls->fixes, ((struct fixes){v->s, &tmp.id}));
+		}
+		else {
+			load_comp_value(ls, &elem, &tmp, eid, v);
+		}
+		
+		char* src = elem.isPtr ? tmp.vp : (char*)&tmp.vp;
+		
+		// redirect the references just deferred into the temporary
+		for(size_t f = fixCnt; f < VEC_LEN(&ls->fixes); f++) {
+			struct fixes* fx = &VEC_ITEM(&ls->fixes, f);
+			VEC_PUSH(&ls->arrFixes, ((struct arrFix){fx->name, cd->id, c->arrOff + k, (char*)fx->target - src, 0}));
+		}
+		for(size_t f = convCnt; f < VEC_LEN(&ls->convDefer); f++) {
+			struct convDefer* cv = &VEC_ITEM(&ls->convDefer, f);
+			VEC_PUSH(&ls->arrFixes, ((struct arrFix){cv->name, cd->id, c->arrOff + k, (char*)cv->target - src, 1}));
+		}
+		VEC_LEN(&ls->fixes) = fixCnt;
+		VEC_LEN(&ls->convDefer) = convCnt;
+		
+		memcpy(data + k * cd->arr.elemSize, src, cd->arr.elemSize);
+		if(elem.isPtr) free(tmp.vp);
+		
+		if(link) link = link->next;
+	}
+}
+
+
+
+// market sinks (infinite buyers)
+static void load_sinks(LoaderState* ls, Market* m, json_value_t* j_sinks) {
+	if(!j_sinks) return;
+	
+	json_link_t* link = j_sinks->arr.head;
+	while(link) {
+		json_value_t* v = link->v;
+		
+		long price = json_obj_get_int(v, "maxBuyPrice", 0);
+		MarketSink* s = Market_AddSink(m, 0, price);
+		
+		s->name = json_obj_get_strdup(v, "name");
+		s->maxBuysPerTick = json_obj_get_int(v, "maxBuysPerTick", -1);
+		
+		
+		char* item = json_obj_get_str(v, "item");
+		
+		LOG("Deferring '%s' at line %d", item, __LINE__);
+		VEC_PUSH(&ls->fixes, ((struct fixes){item, &s->item}));
+		
+		link = link->next;
+	}
+}
+
+
 int Economy_LoadConfig(Economy* ec, char* path) {
 	json_file_t* jsf = json_load_path(path);
 	if(!jsf) {
@@ -51,21 +258,16 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 	}
 	
 
-	// entity id references are done through string aliases
-	// a lookup table of actual id's is used by a list of
-	//   reference locations to match strings to id's 
-	//   without regard to declaration order 
-	HT(econid_t) nameLookup;
-	HT(Conversion*) conversionLookup;
-	VEC(struct fixes {char* name; econid_t* target;}) fixes;
-	VEC(struct invDefer {Inventory* inv; char* name; long count;}) invDefer;
-	VEC(struct convDefer {char* name; Conversion** target;}) convDefer;
-	
-	HT_init(&nameLookup, 1024);	
-	HT_init(&conversionLookup, 1024);	
-	VEC_INIT(&fixes);
-	VEC_INIT(&invDefer);
-	VEC_INIT(&convDefer);
+	LoaderState ls;
+	
+	HT_init(&ls.nameLookup, 1024);	
+	HT_init(&ls.conversionLookup, 1024);	
+	VEC_INIT(&ls.fixes);
+	VEC_INIT(&ls.invDefer);
+	VEC_INIT(&ls.convDefer);
+	VEC_INIT(&ls.compFixes);
+	VEC_INIT(&ls.arrFixes);
+	ls.ec = ec;
 
 	
 	// component definitions
@@ -101,8 +303,23 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 				return 4;
 			} 
 			
-			cd->isPtr = g_CompTypeIsPtr[cd->type];
-						
+			// array elements are stored by value in the def
+			cd->isPtr = cd->isArray ? 0 : g_CompTypeIsPtr[cd->type];
+			cd->arr.elemSize = InternalCompTypeSize(cd->type);
+			
+			if(cd->isArray && (cd->type == CT_str || cd->type == CT_roadspan || cd->type == CT_roadconnect)) {
+				LOG("Arrays of %s are not supported\n", typestr + off);
+				return 4;
+			}
+			
+			json_value_t* j_def = json_obj_get_val(link->v, "default");
+			if(j_def) {
+				cd->def = calloc(1, sizeof(*cd->def));
+				cd->def->type = cd->id;
+				load_comp_value(&ls, cd, cd->def, 0, j_def);
+				cd->hasDefault = 1;
+			}
+			
 			link = link->next;
 		}
 		
@@ -132,6 +349,39 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 //				VEC_PUSH(&fixes, ((struct fixes){fuseName, &ed->fusedInv}));
 //			}
 			
+			// components every entity of this type starts with:
+			//   either a name, or [name, local default value]
+			json_value_t* j_dcomps = json_obj_get_val(link->v, "defaultComps");
+			if(j_dcomps && j_dcomps->type == JSON_TYPE_ARRAY) {
+				json_link_t* dlink = j_dcomps->arr.head;
+				while(dlink) {
+					json_value_t* j_dc = dlink->v;
+					json_value_t* j_dname = j_dc->type == JSON_TYPE_ARRAY ? j_dc->arr.head->v : j_dc;
+					
+					int defID = Econ_CompTypeFromName(ec, j_dname->s);
+					if(defID < 0) {
+						LOG("Unknown default component '%s' on '%s'", j_dname->s, ed->name);
+						dlink = dlink->next;
+						continue;
+					}
+					
+					VEC_INC(&ed->defaultComps);
+					memset(&VEC_TAIL(&ed->defaultComps), 0, sizeof(VEC_TAIL(&ed->defaultComps)));
+					VEC_TAIL(&ed->defaultComps).defID = defID;
+					
+					if(j_dc->type == JSON_TYPE_ARRAY && j_dc->arr.head->next) {
+						Comp* c = &VEC_TAIL(&ed->defaultComps).localDefault;
+						c->type = defID;
+						load_comp_value(&ls, Econ_GetCompDef(ec, defID), c, 0, j_dc->arr.head->next->v);
+						VEC_TAIL(&ed->defaultComps).hasLocalDefault = 1;
+					}
+					
+					dlink = dlink->next;
+				}
+			}
+			
+			EntityDef_CompileProto(ec, ed);
+			
 			link = link->next;
 		}
 		
@@ -164,12 +414,12 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 			// put the id reference string in the lookup for later
 			char* idString = json_obj_get_str(j_ent, "id");
 			if(idString) {
-				HT_set(&nameLookup, idString, e->id);
+				HT_set(&ls.nameLookup, idString, e->id);
 			}
 			
-			// read the component values
+			// read the component values; anything not listed keeps the prototype's value
 			json_value_t* j_comps = json_obj_get_val(j_ent, "comps");
-			json_link_t* clink = j_comps->arr.head;
+			json_link_t* clink = j_comps ? j_comps->arr.head : NULL;
 			while(clink) {
 				json_value_t* j_comp = clink->v;
 				
@@ -178,59 +428,9 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 				CompDef* cd = Econ_GetCompDefName(ec, compName);
 				Comp* c = Entity_AssertComp(e, cd->id);
 				
-				if(cd->isPtr) {
-					c->vp = calloc(1, InternalCompTypeSize(cd->type));
-				}
-								
 				// read and set the component value
 				json_value_t* j_cval = j_comp->arr.head->next->v;
-							
-				switch(cd->type) {
-					default:
-						LOG("unknown component type: %d", cd->type);
-						exit(1);
-					
-					case CT_float: c->d = json_as_double(j_cval); break;
-					
-					case CT_int: c->n = json_as_int(j_cval); break;
-					
-					case CT_str: c->str = strdup(j_cval->s); break;
-					
-					case CT_id: 
-						VEC_PUSH(&fixes, ((struct fixes){j_cval->s, &c->id}));
-						break;
-						
-					case CT_itemRate:
-						LOG("Deferring '%s' at line %d", j_cval->arr.head->v->s, __LINE__);
-						VEC_PUSH(&fixes, ((struct fixes){j_cval->arr.head->v->s, &c->itemRate->item}));
-						c->itemRate->rate = json_as_float(j_cval->arr.head->next->v);
-						break;
-					
-					case CT_itemPrice:
-						LOG("Deferring '%s' at line %d", j_cval->arr.head->v->s, __LINE__);
-						VEC_PUSH(&fixes, ((struct fixes){j_cval->arr.head->v->s, &c->itemPrice->item}));
-						c->itemPrice->price = json_as_int(j_cval->arr.head->next->v);
-						break;
-					
-					case CT_conversion:
-						c->convertRate->acc = 0;
-						c->convertRate->rate = json_as_float(j_cval->arr.head->v);
-						LOG("Deferring '%s' at line %d", j_cval->arr.head->next->v->s, __LINE__);
-						VEC_PUSH(&convDefer, ((struct convDefer){j_cval->arr.head->next->v->s, &c->convertRate->c}));		
-						break;
-						
-					case CT_roadspan:
-						c->roadSpan->a.x = json_as_float(j_cval->arr.head->v);
-						c->roadSpan->a.y = json_as_float(j_cval->arr.head->next->v);
-						c->roadSpan->b.x = json_as_float(j_cval->arr.head->next->next->v);
-						c->roadSpan->b.y = json_as_float(j_cval->arr.head->next->next->next->v);
-						break;
-					
-					case CT_roadconnect:
-						
-						break;	
-				}
-				
+				load_comp_value(&ls, cd, c, e->id, j_cval);
 				
 				clink = clink->next;
 			}
@@ -249,9 +449,8 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 					itemName = j_item->arr.head->v->s;
 					count = json_as_int(j_item->arr.head->next->v);
 					
-					if(!e->inv) e->inv = Inv_New();
 					LOG("Deferring '%s' at line %d", itemName, __LINE__);
-					VEC_PUSH(&invDefer, ((struct invDefer){e->inv, itemName, count}));
+					VEC_PUSH(&ls.invDefer, ((struct invDefer){e->id, itemName, count}));
 					
 					ilink = ilink->next;
 				}
@@ -281,7 +480,7 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 			
 			char* idString = json_obj_get_str(j_conv, "id");
 			if(idString) {
-				HT_set(&conversionLookup, idString, c);
+				HT_set(&ls.conversionLookup, idString, c);
 			}
 			
 			// add the inputs
@@ -301,7 +500,7 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 				
 				char* idString = v->arr.head->v->s;
 				LOG("Deferring '%s' at line %d", idString, __LINE__);
-				VEC_PUSH(&fixes, ((struct fixes){idString, &c->inputs[n].item}));
+				VEC_PUSH(&ls.fixes, ((struct fixes){idString, &c->inputs[n].item}));
 				c->inputs[n].count = json_as_int(v->arr.tail->v);
 				
 				n++;
@@ -326,7 +525,7 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 				
 				char* idString = v->arr.head->v->s;
 				LOG("Deferring '%s' at line %d", idString, __LINE__);
-				VEC_PUSH(&fixes, ((struct fixes){idString, &c->outputs[n].item}));
+				VEC_PUSH(&ls.fixes, ((struct fixes){idString, &c->outputs[n].item}));
 				c->outputs[n].count = json_as_int(v->arr.tail->v);
 				
 				n++;
@@ -339,41 +538,65 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 	}
 	
 	
+	json_value_t* j_ship = json_obj_get_val(root, "shipping");
+	if(j_ship) {
+		json_value_t* v = json_obj_get_val(j_ship, "speed");
+		if(v) ec->ships.speed = json_as_float(v);
+		
+		v = json_obj_get_val(j_ship, "freightRate");
+		if(v) ec->freightRate = json_as_float(v);
+	}
+	
+	
+	json_value_t* j_trades = json_obj_get_val(root, "trades");
+	if(j_trades) {
+		json_value_t* v = json_obj_get_val(j_trades, "capacity");
+		long cap = v ? json_as_int(v) : 65536;
+		if(cap <= 0 || cap > TRADES_MAXCAP) {
+			LOG("Trades: capacity %ld out of range", cap);
+			cap = cap <= 0 ? 65536 : TRADES_MAXCAP;
+		}
+		
+		v = json_obj_get_val(j_trades, "barTicks");
+		int barTicks = v ? json_as_int(v) : 10;
+		
+		Trades_Destroy(&ec->trades);
+		Trades_Init(&ec->trades, &ec->items, cap, barTicks);
+	}
+	
+	
 	json_value_t* j_market = json_obj_get_val(root, "market");
 	if(j_market) {
-		
-		// market sinks (infinite buyers)
-		json_value_t* j_sinks = json_obj_get_val(j_market, "sinks");
-		if(j_sinks) {
-			json_link_t* link = j_sinks->arr.head;
-			while(link) {
-				json_value_t* v = link->v;
-				
-				long price = json_obj_get_int(v, "maxBuyPrice", 0);
-				MarketSink* s = Market_AddSink(ec->m, 0, price);
-				
-				s->name = json_obj_get_strdup(v, "name");
-				s->maxBuysPerTick = json_obj_get_int(v, "maxBuysPerTick", -1);
-				
-				
-				char* item = json_obj_get_str(v, "item");
-				
-				LOG("Deferring '%s' at line %d", item, __LINE__);
-				VEC_PUSH(&fixes, ((struct fixes){item, &s->item}));
-						
-				
-				link = link->next;
+		load_sinks(&ls, ec->m, json_obj_get_val(j_market, "sinks"));
+		ec->m->orderTTL = json_obj_get_int(j_market, "orderTTL", 0);
+	}
+	
+	// regional markets
+	json_value_t* j_markets = json_obj_get_val(root, "markets");
+	if(j_markets && j_markets->type == JSON_TYPE_ARRAY) {
+		json_link_t* link = j_markets->arr.head;
+		for(; link; link = link->next) {
+			json_value_t* v = link->v;
+			
+			json_value_t* j_region = json_obj_get_val(v, "region");
+			if(!j_region) {
+				LOG("Market without a region");
+				continue;
 			}
+			
+			Market* m = Econ_NewMarket(ec, 0);
+			load_id(&ls, j_region, &m->region);
+			load_sinks(&ls, m, json_obj_get_val(v, "sinks"));
+			m->orderTTL = json_obj_get_int(v, "orderTTL", ec->m->orderTTL);
 		}
-		
 	}
 	
 		
 	
 	// fix all the id string references
-	VEC_EACH(&fixes, i, fix) {
+	VEC_EACH(&ls.fixes, i, fix) {
 		econid_t id;
-		if(HT_get(&nameLookup, fix.name, &id)) {
+		if(HT_get(&ls.nameLookup, fix.name, &id)) {
 			LOG("Unknown entity reference: '%s'", fix.name);
 			continue;
 		}
@@ -381,19 +604,33 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 		*fix.target = id;
 	}
 	
-	VEC_EACH(&invDefer, i, defer) {
+	VEC_EACH(&ls.compFixes, i, fix) {
 		econid_t id;
-		if(HT_get(&nameLookup, defer.name, &id)) {
+		if(HT_get(&ls.nameLookup, fix.name, &id)) {
+			LOG("Unknown entity reference: '%s'", fix.name);
+			continue;
+		}
+		
+		*Entity_Get_id(ec, Econ_GetEntity(ec, fix.eid), fix.compType) = id;
+	}
+	
+	// items get their dense indices in declaration order
+	// conversions are measured too, so their items have to be resolved
+	Econ_BuildItems(ec);
+	
+	VEC_EACH(&ls.invDefer, i, defer) {
+		econid_t id;
+		if(HT_get(&ls.nameLookup, defer.name, &id)) {
 			LOG("Unknown entity reference: '%s'", defer.name);
 			continue;
 		}
 		
-		Inv_AddItem(defer.inv, id, defer.count);
+		Entity_InvAddItem(ec, Econ_GetEntity(ec, defer.eid), id, defer.count);
 	}
 	
-	VEC_EACH(&convDefer, i, defer) {
+	VEC_EACH(&ls.convDefer, i, defer) {
 		Conversion* c;
-		if(HT_get(&conversionLookup, defer.name, &c)) {
+		if(HT_get(&ls.conversionLookup, defer.name, &c)) {
 			LOG("Unknown conversion reference: '%s'", defer.name);
 			continue;
 		}
@@ -401,34 +638,151 @@ int Economy_LoadConfigJSON(Economy* ec, json_value_t* root) {
 		*defer.target = c;
 	}
 	
+	VEC_EACH(&ls.arrFixes, i, fix) {
+		CompDef* cd = Econ_GetCompDef(ec, fix.compType);
+		char* target = cd->arr.data + fix.elem * cd->arr.elemSize + fix.offset;
+		
+		if(fix.isConv) {
+			Conversion* c;
+			if(HT_get(&ls.conversionLookup, fix.name, &c)) {
+				LOG("Unknown conversion reference: '%s'", fix.name);
+				continue;
+			}
+			*(Conversion**)target = c;
+		}
+		else {
+			econid_t id;
+			if(HT_get(&ls.nameLookup, fix.name, &id)) {
+				LOG("Unknown entity reference: '%s'", fix.name);
+				continue;
+			}
+			*(econid_t*)target = id;
+		}
+	}
+	
+	
+	// recurring payments
+	json_value_t* j_flows = json_obj_get_val(root, "cashflows");
+	if(j_flows && j_flows->type == JSON_TYPE_ARRAY) {
+		json_link_t* link = j_flows->arr.head;
+		for(; link; link = link->next) {
+			json_value_t* v = link->v;
+			
+			econid_t ids[2] = {0, 0};
+			char* keys[2] = {"from", "to"};
+			for(int k = 0; k < 2; k++) {
+				json_value_t* j_id = json_obj_get_val(v, keys[k]);
+				if(!j_id) continue;
+				
+				if(j_id->type != JSON_TYPE_STRING) ids[k] = json_as_int(j_id);
+				else if(HT_get(&ls.nameLookup, j_id->s, &ids[k])) {
+					LOG("Unknown entity reference: '%s'", j_id->s);
+				}
+			}
+			
+			money_t amount = json_obj_get_int(v, "amount", 0);
+			uint32_t freq = json_obj_get_int(v, "frequency", 0);
+			
+			if(!Economy_AddCashflow(ec, amount, ids[0], ids[1], freq, json_obj_get_str(v, "desc"))) {
+				LOG("Invalid cashflow, line %d", __LINE__);
+			}
+		}
+	}
+	
 	
 	// fuse inventories
 	VECMP_EACH(&ec->entities, i, e) {
+		if(e->dead) continue;
+		
 		EntityDef* ed = Economy_GetEntityDef(ec, e->type);
 		
-		if(ed->fusedInv) {
-			Comp* c = Entity_GetComp(e, ed->fusedInv);
-			Entity* e_loc = Econ_GetEntity(ec, c->id);
+		if(ed && ed->fusedInv) {
+			econid_t* loc = Entity_Get_id(ec, e, ed->fusedInv);
+			if(!loc || !*loc) continue;
 			
-			Entity_FuseInventories(e_loc, e);
+			Entity* e_loc = Econ_GetEntity(ec, *loc);
+			
+			Entity_FuseInventories(ec, e_loc, e);
 		}
 		
 	}
 	
+	// warehouse capacity goes on the inventory, so fused entities share it
+	Econ_BuildStorage(ec);
+	
+	
+	Econ_BuildMarketIndex(ec);
+	Econ_BuildSpatial(ec);
+	Econ_BuildRoads(ec);
+	Econ_BuildLedger(ec);
+	Econ_BuildTotals(ec);
 	
 	
+	// shared memory state for outside observers
+	json_value_t* j_pub = json_obj_get_val(root, "publish");
+	if(j_pub) {
+		char* cols[PUB_MAXCOLS];
+		int colCnt = 0;
+		
+		json_value_t* j_cols = json_obj_get_val(j_pub, "columns");
+		if(j_cols && j_cols->type == JSON_TYPE_ARRAY) {
+			json_link_t* link = j_cols->arr.head;
+			for(; link && colCnt < PUB_MAXCOLS; link = link->next) {
+				if(link->v->type == JSON_TYPE_STRING) cols[colCnt++] = link->v->s;
+			}
+		}
+		
+		Publisher_Close(ec->publisher);
+		ec->publisher = Econ_OpenPublisher(ec,
+			json_obj_get_str(j_pub, "name"),
+			json_obj_get_int(j_pub, "every", 1),
+			json_obj_get_str(j_pub, "entityType"),
+			cols, colCnt
+		);
+	}
+	
 	
-	VEC_FREE(&convDefer);
-	VEC_FREE(&invDefer);
-	VEC_FREE(&fixes);
-	HT_destroy(&nameLookup);
-	HT_destroy(&conversionLookup);
+	VEC_FREE(&ls.arrFixes);
+	VEC_FREE(&ls.compFixes);
+	VEC_FREE(&ls.convDefer);
+	VEC_FREE(&ls.invDefer);
+	VEC_FREE(&ls.fixes);
+	HT_destroy(&ls.nameLookup);
+	HT_destroy(&ls.conversionLookup);
 
 	return 0;
 }
 
 
 
+#define SELL_CHUNK 1024
+
+struct sell_job {
+	Economy* ec;
+	int sellsid;
+};
+
+static void sell_job(void* arg, long chunk, int worker) {
+	struct sell_job* job = arg;
+	Economy* ec = job->ec;
+	
+	econid_t end = MIN(ec->entitySlots, (chunk + 1) * SELL_CHUNK);
+	for(econid_t id = chunk * SELL_CHUNK; id < end; id++) {
+		Entity* e = &VECMP_ITEM(&ec->entities, id);
+		if(e->dead) continue;
+		
+		int n;
+		ItemPrice* ip = Entity_Elems_itemPrice(ec, e, job->sellsid, &n);
+		for(int k = 0; k < n; k++) {
+			InvItem* i = Inv_GetItemP(Entity_Inv(ec, e), ip[k].item);
+			if(!i) continue;
+			
+			Market_StageSellOrder(Econ_MarketFor(ec, e), worker, e, i->item, i->count, ip[k].price);
+		}
+	}
+}
+
+
 void Economy_tick(Economy* ec) {
 	ec->tick++;
 	
@@ -437,56 +791,106 @@ void Economy_tick(Economy* ec) {
 	int sellsid = Econ_CompTypeFromName(ec, "sells");
 	
 	
+	// the rates' accumulators advance every tick, so both comps are
+	//   unshared from their prototypes on the first one
 	VECMP_EACH(&ec->entities, i, e) {
-		Comp* c;
+		int n;
+		
+		if(e->dead) continue;
 		
 		// production
-		c = Entity_GetComp(e, prodtypeid);
-		if(c) {
-			if(++c->itemRate->acc >= c->itemRate->rate) {
-				int n = c->itemRate->acc / c->itemRate->rate;
-				Entity_InvAddItem(e, c->itemRate->item, n);
+		ItemRate* ir = Entity_ElemsForWrite_itemRate(ec, e, prodtypeid, &n);
+		for(int k = 0; k < n; k++) {
+			if(ir[k].rate <= 0) continue;
+			
+			if(++ir[k].acc >= ir[k].rate) {
+				int cnt = ir[k].acc / ir[k].rate;
 				
-				c->itemRate->acc -= c->itemRate->rate * n;
+				// anything that doesn't fit is lost
+				Inventory* inv = Entity_AssertInv(ec, e);
+				long fits = MIN(cnt, Inv_ItemRoom(inv, ir[k].item));
+				if(fits > 0) Inv_AddItem(inv, ir[k].item, fits);
+				
+				ir[k].acc -= ir[k].rate * cnt;
 			}
 		}
 		
 		// conversion
-		c = Entity_GetComp(e, convtypeid);
-		if(c) {
-			ConvertRate* cr = c->convertRate;
-			Conversion* v = cr->c;
+		ConvertRate* cr = Entity_ElemsForWrite_conversion(ec, e, convtypeid, &n);
+		for(int k = 0; k < n; k++) {
+			if(!cr[k].c || cr[k].rate <= 0) continue;
 			
-			if(++cr->acc >= cr->rate) {
+			Conversion* v = cr[k].c;
+			if(++cr[k].acc >= cr[k].rate) {
 				
-				int cnt = Conv_MaxAvail(v, e->inv);
+				Inventory* inv = Entity_Inv(ec, e);
+				long cnt = Conv_MaxAvail(v, inv);
+				if(cnt > 0) cnt = MIN(cnt, Inv_Room(inv, v->netVolume, v->netWeight));
 				if(cnt > 0) {
-					int n = cr->acc / cr->rate;
-					n = MIN(n, cnt);
-					Conv_DoConversion(v, e->inv, n);
+					int m = cr[k].acc / cr[k].rate;
+					m = MIN(m, cnt);
+					Conv_DoConversion(v, inv, m);
 					
-					cr->acc -= cr->rate * n;
+					cr[k].acc -= cr[k].rate * m;
 				}
 			}
 		}
-		
-		
-		// selling
-		c = Entity_GetComp(e, sellsid);
-		if(c) {
-			InvItem* i = Inv_GetItemP(e->inv, c->itemPrice->item);
-			
-			if(i)
-				Market_AddSellOrder(ec->m, e, i->item, i->count, c->itemPrice->price);
+	}
+	
+	
+	// selling only reads entities, so it runs on the pool
+	// orders are staged per worker and placed in entity order by the drain
+	struct sell_job job = {ec, sellsid};
+	Pool_For(&ec->pool, (ec->entitySlots + SELL_CHUNK - 1) / SELL_CHUNK, sell_job, &job);
+	
+	// clearing is timed on its own for the benchmark
+	struct timespec c0, c1;
+	clock_gettime(CLOCK_MONOTONIC, &c0);
+	
+	// expiry runs first, so returned goods are offered again next tick
+	VEC_EACH(&ec->markets, mi, m) {
+		Market_Expire(m, ec->tick);
+		Market_Drain(m);
+	}
+	
+	Econ_ClearMarkets(ec);
+	Econ_Arbitrage(ec);
+	
+	clock_gettime(CLOCK_MONOTONIC, &c1);
+	ec->clearSec = (c1.tv_sec - c0.tv_sec) + (c1.tv_nsec - c0.tv_nsec) * 1e-9;
+	
+	
+	Econ_DeliverShipments(ec);
+	
+	Econ_RunCashflows(ec);
+	
+	// payment for this tick's purchases
+	VEC_EACH(&ec->markets, mi, m) {
+		VEC_EACHP(&m->fills, i, f) {
+			Ledger_Post(&ec->ledger, f->buyer, f->seller, f->price);
 		}
-		
-		
-		
-		Market_RunSinks(ec->m);
 	}
 	
+	Econ_RecordTrades(ec);
+	Econ_ShipFills(ec);
+	Econ_SettleLedger(ec);
 	
+#ifdef ECON_DEBUG
+	if(Ledger_Check(&ec->ledger)) {
+		LOG("tick %u: ledger balances do not match the money supply", ec->tick);
+	}
+	
+	if(Econ_CheckTotals(ec)) {
+		LOG("tick %u: item totals are not conserved", ec->tick);
+	}
+#endif
 	
+	// structural changes wait for the tick boundary
+	Cmd_Apply(ec, &ec->cmds);
+	
+	if(ec->publisher && ec->tick % ec->publisher->every == 0) {
+		Econ_Publish(ec, ec->publisher);
+	}
 }
 
 
@@ -496,10 +900,31 @@ void Economy_tick(Economy* ec) {
 void Economy_init(Economy* ec) {
 	memset(ec, 0, sizeof(*ec));
 	
-	ec->m = Market_New();
+	Pool_Init(&ec->pool, 0);
+	
+	VEC_INIT(&ec->markets);
+	ec->m = Econ_NewMarket(ec, 0);
+	CmdBuffer_Init(&ec->cmds);
+	
+	Spatial_Init(&ec->spatial, 16);
+	Roads_Init(&ec->roadGraph);
+	ShipQueue_Init(&ec->ships);
+	Ledger_Init(&ec->ledger);
+	CashflowBook_Init(&ec->cashflows);
+	Items_Init(&ec->items);
+	Totals_Init(&ec->totals, &ec->items);
+	Trades_Init(&ec->trades, &ec->items, 65536, 10);
+	ec->cashComp = -1;
+	VEC_INIT(&ec->roads);
+	ec->positionComp = -1;
+	ec->locationComp = -1;
+	ec->storageVolumeComp = -1;
+	ec->storageWeightComp = -1;
 	
 	VECMP_INIT(&ec->entities, 16384);
+	VECMP_INIT(&ec->entityCold, 16384);
 	VECMP_INIT(&ec->conversions, 16384);
+	InvTable_Init(&ec->invs, &ec->items);
 	VECMP_INIT(&ec->compDefs, 16384);
 	VECMP_INIT(&ec->entityDefs, 16384);
 	
@@ -509,10 +934,10 @@ void Economy_init(Economy* ec) {
 	
 	// special entities
 	ec->m->sinkEntity = Econ_NewEntity(ec, 0, "Market Sink Entity");
-	ec->m->sinkEntity->inv = Inv_New();
-	
+	Entity_AssertInv(ec, ec->m->sinkEntity);
 	
-	Economy_LoadConfig(ec, "defs.json");	
+	// sinks pay with money from outside the world
+	Ledger_SetExternal(&ec->ledger, ec->m->sinkEntity->id);
 }
 
 
@@ -3,7 +3,10 @@
 
 
 #include <stdint.h>
+#include <limits.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 
 #include "c3dlas/c3dlas.h"
@@ -37,6 +40,11 @@ typedef uint32_t tick_t; // 4 billion tick limit to world sim time
 #define ECON_CASHMAX (INT64_MAX - 10)
 
 
+typedef struct EcPoint {
+	float x, y;
+} EcPoint;
+
+
 
 
 
@@ -61,8 +69,10 @@ typedef struct EcAsset {
 } EcAsset;
 
 
+// storage capacity, in the items' volume and weight units
 typedef struct EcWarehouse {
-
+	float maxVolume, maxWeight; // 0 for unlimited
+	double volume, weight; // current fill, escrow included
 } EcWarehouse;
 
 #define ECORDERTYPE_ASK 0x00
@@ -147,6 +157,7 @@ typedef struct CommoditySet {
 	X(conversion,  1, ConvertRate, convertRate) \
 	X(roadspan,    1, RoadSpan,    roadSpan) \
 	X(roadconnect, 1, RoadConnect, roadConnect) \
+	X(point,       0, EcPoint,     point) \
 
 
 
@@ -178,18 +189,53 @@ typedef struct EscrowItem {
 typedef struct Inventory {
 	VECMP(InvItem) items;
 	VEC(EscrowItem) escrow;
+	
+	struct CommodityTotals* totals; // may be NULL
+	
+	// fill is kept up to date by every change to the counts, using the
+	//   attributes in effect when the change was made
+	EcWarehouse store;
+	struct ItemTable* attrs; // may be NULL
 } Inventory;
 
 
+typedef uint32_t invid_t; // handle into an InvTable, 0 for none
+
+// an inventory and every entity sharing it through fusing
+typedef struct InvSlot {
+	Inventory inv;
+	VEC(econid_t) owners; // empty when the slot is free
+} InvSlot;
+
+typedef struct InvTable {
+	VECMP(InvSlot) slots; // slot 0 is the null handle
+	VEC(invid_t) freeSlots;
+	
+	struct ItemTable* items; // handed to each inventory for its fill
+} InvTable;
+
+static inline InvSlot* InvTable_Slot(InvTable* t, invid_t h) {
+	return &VECMP_ITEM(&t->slots, h);
+}
+
+static inline Inventory* InvTable_Get(InvTable* t, invid_t h) {
+	return h ? &VECMP_ITEM(&t->slots, h).inv : NULL;
+}
+
+static inline int InvTable_Shares(InvTable* t, invid_t h) {
+	return h ? VEC_LEN(&VECMP_ITEM(&t->slots, h).owners) : 0;
+}
+
+
 
 
 typedef struct RoadSpan {
-	struct { float x, y; } a, b;
+	EcPoint a, b;
 } RoadSpan;
 
 typedef struct RoadConnect {
 	econid_t to;
-	struct {float x, y; } where;
+	EcPoint where;
 } RoadConnect;
 
 typedef struct ItemRate {
@@ -211,6 +257,9 @@ typedef struct Conversion {
 	int inputCnt, outputCnt;
 	InvItem* inputs;
 	InvItem* outputs;
+	
+	// storage change per conversion, filled in by Econ_BuildItems
+	float netVolume, netWeight;
 } Conversion;
 
 
@@ -228,18 +277,37 @@ typedef struct CompDef {
 	enum CompType type;
 	char isArray;
 	char isPtr;
+	
+	char hasDefault;
+	struct Comp* def;
+	
+	// element storage for every array component of this def, by value
+	struct {
+		char* data;
+		size_t elemSize;
+		uint32_t len, alloc; // in elements
+		uint32_t garbage; // elements no longer referenced by any comp
+	} arr;
 } CompDef;
 
 #define IF_PTR_1 *
 #define IF_PTR_0
 #define IF_PTR(a) IF_PTR_ ## a
+#define IF_ADDR_1
+#define IF_ADDR_0 &
+#define IF_ADDR(a) IF_ADDR_ ## a
+
+// vp (or an array range) belongs to a prototype; copy it before writing
+#define COMPF_SHARED 0x0001
 
 typedef struct Comp {
-	int type;
-	unsigned short length;
+	unsigned short type;
+	unsigned short flags;
+	unsigned short length; // elements, for arrays
 	unsigned short alloc;
 	union {
 		void* vp;
+		uint32_t arrOff; // first element in the def's array storage
 		
 		#define X(x, a, b, c) b IF_PTR(a) c;
 			COMP_TYPE_LIST
@@ -247,6 +315,11 @@ typedef struct Comp {
 	};
 } Comp;
 
+// the elements of an array component; valid until the def's storage grows
+static inline void* Comp_ArrayData(CompDef* cd, Comp* c) {
+	return cd->arr.data + (size_t)c->arrOff * cd->arr.elemSize;
+}
+
 
 typedef struct EntityDef {
 	int id;
@@ -260,48 +333,129 @@ typedef struct EntityDef {
 		Comp localDefault;
 	}) defaultComps;
 	
+	// compiled from defaultComps; new entities start as a copy of this
+	int protoCnt;
+	Comp* proto;
+	
+	// every live entity of this type; destroying one swap-removes it, so
+	//   the order is only creation order until the first destroy
+	VEC(econid_t) instances;
+	
 } EntityDef;
 
 
+// what the tick touches; everything else is in EntityCold
 typedef struct Entity {
 	econid_t id;
 	unsigned int dead : 1;
-	unsigned int _pad : 23;
+	unsigned int type : 31;
+	
+	VEC(Comp) comps;
+	invid_t inv; // in ec->invs
+} Entity;
+
+static inline Comp* Entity_GetComp(Entity* e, int compType) {
+	VEC_EACHP(&e->comps, i, cp) {
+		if(cp->type == compType) return cp;
+	}
+	
+	return NULL;
+}
+
+
+// bookkeeping kept out of the hot array, indexed by entity id
+typedef struct EntityCold {
 	unsigned int uniqueCounter : 8;
-	unsigned int type;
+	unsigned int typeIdx; // position in its def's instances
 	tick_t born, died;
 	
-	VEC(Comp) comps;
-	Inventory* inv;
-	 
 	// for debugging:
 	char* name;
-} Entity;
+} EntityCold;
 
 
 
 
+#include "items.h"
 #include "market.h"
+#include "cmd.h"
+#include "spatial.h"
+#include "roads.h"
+#include "ship.h"
+#include "ledger.h"
+#include "cashflow.h"
+#include "totals.h"
+#include "trades.h"
+#include "pool.h"
+#include "ensemble.h"
+#include "publish.h"
+#include "query.h"
 
 
 
 typedef struct Economy {
 	tick_t tick;
+	double clearSec; // wall time of the last tick's market clearing
 
 	
+	// the global market, also first in markets
 	Market* m;
+	VEC(Market*) markets;
+	Market** regionMarkets; // by region entity id
+	econid_t regionAlloc;
+	float freightRate; // money per unit of goods per unit of distance
 	
 	VECMP(EntityDef) entityDefs;
 	VECMP(CompDef) compDefs;
 	
 	VECMP(Entity) entities;
+	VECMP(EntityCold) entityCold; // parallel to entities
 	VECMP(Conversion) conversions;
 	
+	// every inventory; fused entities share one
+	InvTable invs;
+	int storageVolumeComp, storageWeightComp; // component def ids, -1 if undefined
+	
+	// item attributes, and the dense item index
+	ItemTable items;
+	
+	// entity ids are handed out from the free list first, then fresh
+	//   from nextID; both are safe to reserve from any thread
+	econid_t entitySlots; // slots allocated in entities
+	atomic_uint nextID;
+	atomic_long freeCursor;
+	VEC(econid_t) freeIDs;
+	
+	// structural changes made during a tick
+	CmdBuffer cmds;
+	
 	VEC(econid_t) convertors;
 	VEC(econid_t) roads;
+	RoadGraph roadGraph;
+	
+	// goods in transit between buyers and sellers
+	ShipQueue ships;
+	
+	// cash balances; the cash components mirror it
+	Ledger ledger;
+	int cashComp; // component def id, -1 if undefined
+	
+	CashflowBook cashflows;
 	
-// 	// total amount of each commodity in the world
-//	int64_t commodityTotals[CT_MAXVALUE];
+	// world totals of every item
+	CommodityTotals totals;
+	
+	// recent fills and per-item price history
+	TradeTape trades;
+	
+	// NULL unless the world asks for one
+	Publisher* publisher;
+	
+	WorkerPool pool;
+	
+	// positioned entities and road spans
+	SpatialIndex spatial;
+	int positionComp, locationComp; // component def ids, -1 if undefined
 	
 //	entityid_t parcelGrid[64][64];
 	
@@ -310,11 +464,33 @@ typedef struct Economy {
 
 
 Entity* Econ_NewEntity(Economy* ec, int type, char* name);
+Entity* Econ_InitEntity(Economy* ec, econid_t id, int type, char* name);
+void Econ_DestroyEntity(Economy* ec, Entity* e);
+econid_t Econ_ReserveID(Economy* ec);
+void Econ_FlushFreeIDs(Economy* ec);
+void Econ_SpawnEntities(Economy* ec, int type, long count, econid_t* ids);
 Entity* Economy_NewEntityName(Economy* ec, char* typeName, char* name);
 int Economy_EntityType(Economy* ec, char* typeName);
 EntityDef* Economy_NewEntityDef(Economy* ec);
 EntityDef* Economy_GetEntityDef(Economy* ec, int typeid);
+void EntityDef_CompileProto(Economy* ec, EntityDef* ed);
 Entity* Econ_GetEntity(Economy* ec, econid_t id);
+EntityCold* Econ_GetEntityCold(Economy* ec, econid_t id);
+
+void Econ_BuildSpatial(Economy* ec);
+void Econ_SpatialUpdate(Economy* ec, Entity* e);
+int Econ_EntityPosition(Economy* ec, Entity* e, EcPoint* out);
+
+Market* Econ_NewMarket(Economy* ec, econid_t region);
+void Econ_BuildMarketIndex(Economy* ec);
+Market* Econ_MarketFor(Economy* ec, Entity* e);
+void Econ_ClearMarkets(Economy* ec);
+void Econ_Arbitrage(Economy* ec);
+
+void Econ_BuildRoads(Economy* ec);
+void Econ_RoadAdded(Economy* ec, Entity* e, int internalType);
+float Econ_TransportCost(Economy* ec, econid_t from, econid_t to);
+int Econ_Route(Economy* ec, econid_t from, econid_t to, uint32_t* out, int maxOut);
 
 CompDef* Economy_NewCompDef(Economy* ec);
 CompDef* Econ_GetCompDef(Economy* ec, int compType);
@@ -325,12 +501,84 @@ int CompInternalTypeFromName(char* t);
 int Economy_LoadConfig(Economy* ec, char* path);
 int Economy_LoadConfigJSON(Economy* ec, json_value_t* root);
 Comp* Entity_GetCompName(Economy* ec, Entity* e, char* compName);
-Comp* Entity_GetComp(Entity* e, int compType);
 Comp* Entity_AddComp(Entity* e, int compType);
 Comp* Entity_AssertComp(Entity* e, int compType);
+void Entity_RemoveComp(Economy* ec, Entity* e, int compType);
+void Comp_Unshare(Economy* ec, Comp* c);
+void Comp_Free(Economy* ec, Comp* c);
+void* Comp_Data(Economy* ec, Comp* c, int* count);
+double Econ_CompNumber(Economy* ec, Entity* e, int compType, double def);
+void* Comp_ArrayResize(CompDef* cd, Comp* c, int count);
+void Econ_CompactCompArrays(Economy* ec);
 Comp* Entity_SetCompName(Economy* ec, Entity* e, char* compName, ...);
 Comp* Entity_SetComp(Economy* ec, Entity* e, int compType, ...);
 Comp* Entity_SetComp_va(Economy* ec, Entity* e, int ctype, va_list va);
+void* Entity_CompForWrite(Economy* ec, Entity* e, int compType);
+
+// with ECON_DEBUG, typed entity accessors check the comp's def, and abort
+//   when it is of another internal type, or an array where one is not allowed
+#ifdef ECON_DEBUG
+	#define COMP_CHECK(ec, compType, internalType, allowArray) \
+		Econ_CompCheck(ec, compType, internalType, allowArray, __func__)
+#else
+	#define COMP_CHECK(ec, compType, internalType, allowArray) ((void)0)
+#endif
+void Econ_CompCheck(Economy* ec, int compType, int internalType, int allowArray, const char* fn);
+
+// typed accessors for each internal type, x being its json name:
+//   Comp_x(c)                      the value of a non-array comp
+//   Comp_xElems(cd, c, &count)     the elements of a comp of def cd; non-arrays have one
+//   Entity_Get_x(ec, e, type)      the value of a non-array comp, or NULL when absent
+//   Entity_Set_x(ec, e, type, v)   creates and unshares the comp as needed, then writes v;
+//                                  arrays become one element, strings are taken over
+//   Entity_Elems_x(ec, e, type, &count)
+//                                  the comp's elements as a column, or NULL when absent
+//   Entity_ElemsForWrite_x(ec, e, type, &count)
+//                                  the same, unshared from the prototype first
+#define X(x, a, b, c) \
+	static inline b* Comp_##x(Comp* cp) { \
+		return IF_ADDR(a) cp->c; \
+	} \
+	static inline b* Comp_##x##Elems(CompDef* cd, Comp* cp, int* count) { \
+		if(cd->isArray) { \
+			if(count) *count = cp->length; \
+			return Comp_ArrayData(cd, cp); \
+		} \
+		if(count) *count = 1; \
+		return Comp_##x(cp); \
+	} \
+	static inline b* Entity_Get_##x(struct Economy* ec, Entity* e, int compType) { \
+		COMP_CHECK(ec, compType, CT_##x, 0); \
+		Comp* cp = Entity_GetComp(e, compType); \
+		return cp ? Comp_##x(cp) : NULL; \
+	} \
+	static inline b* Entity_Set_##x(struct Economy* ec, Entity* e, int compType, b v) { \
+		COMP_CHECK(ec, compType, CT_##x, 1); \
+		b* p = Entity_CompForWrite(ec, e, compType); \
+		*p = v; \
+		return p; \
+	} \
+	static inline b* Entity_Elems_##x(struct Economy* ec, Entity* e, int compType, int* count) { \
+		COMP_CHECK(ec, compType, CT_##x, 1); \
+		Comp* cp = Entity_GetComp(e, compType); \
+		if(!cp) { \
+			if(count) *count = 0; \
+			return NULL; \
+		} \
+		return Comp_##x##Elems(Econ_GetCompDef(ec, compType), cp, count); \
+	} \
+	static inline b* Entity_ElemsForWrite_##x(struct Economy* ec, Entity* e, int compType, int* count) { \
+		COMP_CHECK(ec, compType, CT_##x, 1); \
+		Comp* cp = Entity_GetComp(e, compType); \
+		if(!cp) { \
+			if(count) *count = 0; \
+			return NULL; \
+		} \
+		if(cp->flags & COMPF_SHARED) Comp_Unshare(ec, cp); \
+		return Comp_##x##Elems(Econ_GetCompDef(ec, compType), cp, count); \
+	}
+	COMP_TYPE_LIST
+#undef X
 int Econ_CompTypeFromName(Economy* ec, char* compName);
 
 char* CompInternalType_GetName(int compInternalType);
@@ -339,20 +587,67 @@ size_t InternalCompTypeSize(int internalType);
 econid_t Econ_FindItem(Economy* ec, char* name);
 
 void Inv_Init(Inventory* inv);
-Inventory* Inv_New();
 void Inv_Destroy(Inventory* inv);
 InvItem* Inv_GetItemP(Inventory* inv, econid_t id);
 InvItem* Inv_AddItem(Inventory* inv, econid_t id, long count);
 InvItem* Inv_AssertItemP(Inventory* inv, econid_t id);
-InvItem* Entity_InvAddItem(Entity* e, econid_t id, long count);
+InvItem* Entity_InvAddItem(Economy* ec, Entity* e, econid_t id, long count);
+InvItem* Entity_InvReceive(Economy* ec, Entity* e, econid_t id, long count);
+InvItem* Inv_Receive(Inventory* inv, econid_t id, long count);
 
 EscrowItem* Inv_GetEscrowItemP(Inventory* inv, econid_t owner, econid_t id);
 EscrowItem* Inv_AssertEscrowItemP(Inventory* inv, econid_t owner, econid_t id);
 EscrowItem* Inv_AddEscrowItem(Inventory* inv, econid_t owner, econid_t id, long count);
 long Inv_MoveToEscrow(Inventory* inv, econid_t newOwner, econid_t item, long count);
+long Inv_TakeEscrow(Inventory* inv, econid_t owner, econid_t item, long count);
+long Inv_ReturnEscrow(Inventory* inv, econid_t owner, econid_t item, long count);
 long Inv_EscrowChangeOwner(Inventory* inv, econid_t oldOwner, econid_t newOwner, econid_t item, long count);
 
-void Entity_FuseInventories(Entity* e_core, Entity* e_extra); 
+// count is the change actually made to the items held, escrow included
+static inline void Inv_AdjustFill(Inventory* inv, econid_t id, long count) {
+	if(!inv->attrs || !count) return;
+	
+	itemidx_t x = Items_Index(inv->attrs, id);
+	if(x == ITEM_NONE) return;
+	
+	inv->store.volume += (double)inv->attrs->volume[x] * count;
+	inv->store.weight += (double)inv->attrs->weight[x] * count;
+}
+
+// how many units of the given size still fit, LONG_MAX when unlimited
+static inline long Inv_Room(Inventory* inv, float volume, float weight) {
+	EcWarehouse* w = &inv->store;
+	double n = LONG_MAX;
+	
+	if(w->maxVolume > 0 && volume > 0) n = MIN(n, (w->maxVolume - w->volume) / volume);
+	if(w->maxWeight > 0 && weight > 0) n = MIN(n, (w->maxWeight - w->weight) / weight);
+	
+	return n >= LONG_MAX ? LONG_MAX : MAX(0, (long)n);
+}
+
+static inline long Inv_ItemRoom(Inventory* inv, econid_t id) {
+	if(!inv->attrs || (inv->store.maxVolume <= 0 && inv->store.maxWeight <= 0)) return LONG_MAX;
+	
+	itemidx_t x = Items_Index(inv->attrs, id);
+	if(x == ITEM_NONE) return LONG_MAX;
+	
+	return Inv_Room(inv, inv->attrs->volume[x], inv->attrs->weight[x]);
+}
+
+void InvTable_Init(InvTable* t, struct ItemTable* items);
+void InvTable_Destroy(InvTable* t);
+invid_t InvTable_New(InvTable* t, struct CommodityTotals* totals);
+
+static inline Inventory* Entity_Inv(Economy* ec, Entity* e) {
+	return InvTable_Get(&ec->invs, e->inv);
+}
+
+Inventory* Entity_AssertInv(Economy* ec, Entity* e);
+void Entity_ReleaseInv(Economy* ec, Entity* e);
+void Entity_FuseInventories(Economy* ec, Entity* e_core, Entity* e_extra); 
+void Entity_SetStorage(Economy* ec, Entity* e, float maxVolume, float maxWeight);
+void Econ_StorageUpdate(Economy* ec, Entity* e);
+void Econ_BuildStorage(Economy* ec);
 
 Conversion* Econ_NewConversion(Economy* ec);
 long Conv_MaxAvail(Conversion* conv, Inventory* inv);
@@ -369,7 +664,6 @@ long Conv_DoConversion(Conversion* conv, Inventory* inv, long count);
 void Economy_tick(Economy* ec);
 /*
 econid_t Economy_AddActor(Economy* ec, char* name, money_t cash);
-econid_t Economy_AddCashflow(Economy* ec, money_t amount, econid_t from, econid_t to, uint32_t freq, char* desc);
 econid_t Economy_AddAsset(Economy* ec, EcAsset* ass);
 */
 void Economy_init(Economy* ec);
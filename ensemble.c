@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+
+#include "econ.h"
+
+
+
+
+// the child side of one member; never returns
+static void run_member(Economy* ec, Ensemble* en, int member, EnsembleSetupFn setup, EnsembleResultFn result, void* arg) {
+	// the publisher's region is the parent's; leave it mapped for the
+	//   parent but never write to it from here
+	ec->publisher = NULL;
+	
+	// only the forking thread exists in the child
+	int threads = en->threadsPerMember > 0 ? en->threadsPerMember : 1;
+	Pool_Init(&ec->pool, threads);
+	
+	VEC_EACH(&ec->markets, i, m) {
+		if(m->queueCnt < threads) Market_SetWorkers(m, threads);
+	}
+	
+	if(setup) setup(ec, member, arg);
+	
+	for(tick_t t = 0; t < en->ticks; t++) {
+		Economy_tick(ec);
+	}
+	
+	if(result) result(ec, member, Ensemble_Result(en, member), arg);
+	en->status[member] = ENS_DONE;
+	
+	// skip atexit handlers and the parent's copies of open stdio buffers
+	fflush(NULL);
+	_exit(0);
+}
+
+
+// runs every member to completion and collects their results
+// ec is left untouched; members that crash are marked ENS_FAILED
+// returns the number of failed members, or -1 if nothing could be started
+int Econ_RunEnsemble(Economy* ec, Ensemble* en, EnsembleSetupFn setup, EnsembleResultFn result, void* arg) {
+	if(en->members <= 0) return 0;
+	
+	int parallel = en->parallel > 0 ? en->parallel : sysconf(_SC_NPROCESSORS_ONLN);
+	parallel = MAX(1, MIN(parallel, en->members));
+	
+	// shared with the children, so it survives their exit
+	// results go first to keep them aligned
+	size_t resultsSize = en->resultSize * en->members;
+	size_t size = resultsSize + en->members;
+	void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED) {
+		LOG("Ensemble: could not map %zu bytes for results", size);
+		return -1;
+	}
+	
+	en->results = mem;
+	en->status = (char*)mem + resultsSize;
+	
+	pid_t* pids = calloc(1, sizeof(*pids) * en->members);
+	
+	// anything buffered now would be written again by every child
+	fflush(NULL);
+	
+	int next = 0;
+	int running = 0;
+	int failed = 0;
+	
+	while(next < en->members || running > 0) {
+		while(running < parallel && next < en->members) {
+			pid_t pid = fork();
+			
+			if(pid == 0) run_member(ec, en, next, setup, result, arg);
+			
+			if(pid < 0) {
+				LOG("Ensemble: fork failed for member %d", next);
+				en->status[next] = ENS_FAILED;
+				failed++;
+			}
+			else {
+				pids[next] = pid;
+				running++;
+			}
+			
+			next++;
+		}
+		
+		if(!running) break;
+		
+		// only our own members are reaped; the caller may have children
+		//   of its own waiting on their own waitpid
+		int reaped = 0;
+		for(int i = 0; i < next; i++) {
+			if(!pids[i]) continue;
+			
+			int ws;
+			pid_t pid = waitpid(pids[i], &ws, WNOHANG);
+			if(pid == 0) continue;
+			
+			if(pid < 0 || en->status[i] != ENS_DONE || !WIFEXITED(ws) || WEXITSTATUS(ws)) {
+				LOG("Ensemble: member %d failed", i);
+				en->status[i] = ENS_FAILED;
+				failed++;
+			}
+			
+			pids[i] = 0;
+			running--;
+			reaped++;
+		}
+		
+		if(!reaped) {
+			struct timespec ts = {0, 1000000};
+			nanosleep(&ts, NULL);
+		}
+	}
+	
+	free(pids);
+	
+	return failed;
+}
+
+
+void* Ensemble_Result(Ensemble* en, int member) {
+	return (char*)en->results + en->resultSize * member;
+}
+
+
+void Ensemble_Free(Ensemble* en) {
+	if(en->results) munmap(en->results, en->resultSize * en->members + en->members);
+	
+	en->status = NULL;
+	en->results = NULL;
+}
@@ -0,0 +1,45 @@
+
+
+
+// runs many variants of one loaded world side by side
+//   each member is a fork()ed child, so it starts as a copy-on-write copy of
+//   the parent's economy; only the pages a member changes get copied
+//   results come back through a shared anonymous mapping
+
+
+
+struct Economy;
+
+// applies the member's variation to its private copy of the world
+typedef void (*EnsembleSetupFn)(struct Economy* ec, int member, void* arg);
+
+// writes the member's result into out, which is resultSize bytes
+typedef void (*EnsembleResultFn)(struct Economy* ec, int member, void* out, void* arg);
+
+
+enum EnsembleStatus {
+	ENS_PENDING = 0,
+	ENS_DONE,
+	ENS_FAILED,
+};
+
+
+typedef struct Ensemble {
+	int members;
+	int parallel; // children running at once, <= 0 for one per core
+	int threadsPerMember; // worker pool size inside each child, <= 0 for 1
+	tick_t ticks; // run by each member after setup
+	
+	size_t resultSize;
+	
+	// filled in by Econ_RunEnsemble, freed by Ensemble_Free
+	void* results; // members * resultSize bytes
+	char* status; // enum EnsembleStatus per member
+} Ensemble;
+
+
+
+
+int Econ_RunEnsemble(struct Economy* ec, Ensemble* en, EnsembleSetupFn setup, EnsembleResultFn result, void* arg);
+void* Ensemble_Result(Ensemble* en, int member);
+void Ensemble_Free(Ensemble* en);
@@ -28,6 +28,7 @@ EntityDef* Economy_NewEntityDef(Economy* ec) {
 	VECMP_INC(&ec->entityDefs); \
 	id = VECMP_LAST_INS_INDEX(&ec->entityDefs); \
 	ed = &VECMP_ITEM(&ec->entityDefs, id); \
+	memset(ed, 0, sizeof(*ed));
 	ed->id = id;
 	
 	return ed;
@@ -42,65 +43,181 @@ EntityDef* Economy_GetEntityDef(Economy* ec, int typeid) {
 	return NULL;
 }
 
+
+// builds the component block every new entity of this type is copied from
+void EntityDef_CompileProto(Economy* ec, EntityDef* ed) {
+	free(ed->proto);
 	
+	ed->protoCnt = VEC_LEN(&ed->defaultComps);
+	ed->proto = calloc(1, sizeof(*ed->proto) * ed->protoCnt);
 	
-Entity* Econ_NewEntity(Economy* ec, int type, char* name) {
-	econid_t id;
+	VEC_EACHP(&ed->defaultComps, i, dc) {
+		CompDef* cd = Econ_GetCompDef(ec, dc->defID);
+		Comp* c = &ed->proto[i];
+		
+		if(dc->hasLocalDefault) *c = dc->localDefault;
+		else if(cd->hasDefault) *c = *cd->def;
+		
+		c->type = dc->defID;
+		
+		if(cd->isArray) {
+			c->flags |= COMPF_SHARED;
+		}
+		else if(cd->isPtr) {
+			if(!c->vp) c->vp = calloc(1, InternalCompTypeSize(cd->type));
+			c->flags |= COMPF_SHARED;
+		}
+		else if(cd->type == CT_str) {
+			c->flags |= COMPF_SHARED;
+		}
+	}
+}
+
+	
+	
+// safe to call from any thread; the entity appears once it is initialized
+econid_t Econ_ReserveID(Economy* ec) {
+	long n = atomic_fetch_sub(&ec->freeCursor, 1) - 1;
+	if(n >= 0) return VEC_ITEM(&ec->freeIDs, n);
+	
+	return atomic_fetch_add(&ec->nextID, 1);
+}
+
+
+Entity* Econ_InitEntity(Economy* ec, econid_t id, int type, char* name) {
 	Entity* e;
 	
-	VECMP_INC(&ec->entities);
-	id = VECMP_LAST_INS_INDEX(&ec->entities);
+	// reserved ids may arrive out of order; slots in between stay dead
+	while(ec->entitySlots <= id) {
+		VECMP_INC(&ec->entities);
+		e = &VECMP_ITEM(&ec->entities, ec->entitySlots);
+		memset(e, 0, sizeof(*e));
+		e->id = ec->entitySlots;
+		e->dead = 1;
+		
+		VECMP_INC(&ec->entityCold);
+		memset(&VECMP_ITEM(&ec->entityCold, ec->entitySlots), 0, sizeof(EntityCold));
+		
+		ec->entitySlots++;
+	}
+	
 	e = &VECMP_ITEM(&ec->entities, id);
-	memset(e, 0, sizeof(*e));
+	EntityCold* ce = &VECMP_ITEM(&ec->entityCold, id);
 	
+	memset(e, 0, sizeof(*e));
 	e->id = id;
 	e->type = type;
-	e->name = name;
-	e->born = ec->tick;
+	
+	int gen = ce->uniqueCounter;
+	memset(ce, 0, sizeof(*ce));
+	ce->uniqueCounter = gen;
+	ce->name = name;
+	ce->born = ec->tick;
+	
+	EntityDef* ed = Economy_GetEntityDef(ec, type);
+	if(ed) {
+		ce->typeIdx = VEC_LEN(&ed->instances);
+		VEC_PUSH(&ed->instances, id);
+		
+		// stamp out the prototype; pointer values stay shared until written
+		if(ed->protoCnt) {
+			VEC_DATA(&e->comps) = malloc(sizeof(Comp) * ed->protoCnt);
+			memcpy(VEC_DATA(&e->comps), ed->proto, sizeof(Comp) * ed->protoCnt);
+			VEC_LEN(&e->comps) = ed->protoCnt;
+			VEC_ALLOC(&e->comps) = ed->protoCnt;
+		}
+	}
 	
 //	Inv_Init(&e->inv);
 	
 	return e;
 }
 
-Entity* Econ_GetEntity(Economy* ec, econid_t id) {
-	return &VECMP_ITEM(&ec->entities, id);
+	
+Entity* Econ_NewEntity(Economy* ec, int type, char* name) {
+	return Econ_InitEntity(ec, Econ_ReserveID(ec), type, name);
 }
 
-econid_t Econ_FindItem(Economy* ec, char* name) {
-	int etype = Economy_EntityType(ec, "Item");
+
+// only call between ticks; the id goes back on the free list at the next flush
+void Econ_DestroyEntity(Economy* ec, Entity* e) {
+	if(e->dead) return;
 	
-	VECMP_EACH(&ec->entities, i, e) {
-		if(e->type != etype) continue;
-		
-		Comp* c = Entity_GetCompName(ec, e, "name");
-		if(c && 0 == strcmp(c->str, name)) {
-			return e->id;
-		}
+	EntityCold* ce = Econ_GetEntityCold(ec, e->id);
+	
+	e->dead = 1;
+	ce->died = ec->tick;
+	ce->uniqueCounter++;
+	
+	EntityDef* ed = Economy_GetEntityDef(ec, e->type);
+	if(ed) {
+		econid_t last = VEC_TAIL(&ed->instances);
+		VEC_ITEM(&ed->instances, ce->typeIdx) = last;
+		Econ_GetEntityCold(ec, last)->typeIdx = ce->typeIdx;
+		VEC_LEN(&ed->instances)--;
+	}
+	
+	VEC_EACHP(&e->comps, i, c) {
+		Comp_Free(ec, c);
 	}
+	VEC_FREE(&e->comps);
 	
-	return 0;
+	Entity_ReleaseInv(ec, e);
+	
+	Econ_FlushFreeIDs(ec);
+	VEC_PUSH(&ec->freeIDs, e->id);
+	atomic_store(&ec->freeCursor, VEC_LEN(&ec->freeIDs));
 }
 
 
+// drops free list entries that were reserved since the last flush
+// only call between ticks
+void Econ_FlushFreeIDs(Economy* ec) {
+	long cur = atomic_load(&ec->freeCursor);
+	
+	VEC_LEN(&ec->freeIDs) = MAX(0, MIN(cur, (long)VEC_LEN(&ec->freeIDs)));
+	atomic_store(&ec->freeCursor, VEC_LEN(&ec->freeIDs));
+}
 
 
-InvItem* Entity_InvAddItem(Entity* e, econid_t id, long count) {
-	if(!e->inv) {
-		e->inv = Inv_New();
+// ids may be NULL
+void Econ_SpawnEntities(Economy* ec, int type, long count, econid_t* ids) {
+	for(long i = 0; i < count; i++) {
+		Entity* e = Econ_NewEntity(ec, type, "");
+		if(ids) ids[i] = e->id;
 	}
-	return Inv_AddItem(e->inv, id, count);
 }
 
+Entity* Econ_GetEntity(Economy* ec, econid_t id) {
+	return &VECMP_ITEM(&ec->entities, id);
+}
+
+EntityCold* Econ_GetEntityCold(Economy* ec, econid_t id) {
+	return &VECMP_ITEM(&ec->entityCold, id);
+}
 
-Inventory* Inv_New() {
-	Inventory* inv = calloc(1, sizeof(*inv));
+econid_t Econ_FindItem(Economy* ec, char* name) {
+	ItemTable* it = &ec->items;
 	
-	Inv_Init(inv);
+	uint32_t n;
+	if(HT_get(&it->nameLookup, name, &n)) return 0;
 	
-	return inv;
+	itemidx_t x = VEC_ITEM(&it->nameItems, n);
+	return x != ITEM_NONE ? it->ids[x] : 0;
+}
+
+
+
+
+InvItem* Entity_InvAddItem(Economy* ec, Entity* e, econid_t id, long count) {
+	return Inv_AddItem(Entity_AssertInv(ec, e), id, count);
+}
+
+InvItem* Entity_InvReceive(Economy* ec, Entity* e, econid_t id, long count) {
+	return Inv_Receive(Entity_AssertInv(ec, e), id, count);
 }
 
+
 void Inv_Init(Inventory* inv) {
 	VECMP_INIT(&inv->items, 1024); // max types of items in inv 
 	VEC_INIT(&inv->escrow);
@@ -151,49 +268,122 @@ EscrowItem* Inv_AssertEscrowItemP(Inventory* inv, econid_t owner, econid_t id) {
 }
 
 
-InvItem* Inv_AddItem(Inventory* inv, econid_t id, long count) {
+// returns the change actually made, which is less than count when it would go negative
+static long add_item(Inventory* inv, econid_t id, long count, InvItem** out) {
 	InvItem* item = Inv_GetItemP(inv, id);
+	long before = item ? item->count : 0;
+	
 	if(!item) {
 		if(count < 0) count = 0;
 		VECMP_INSERT(&inv->items, ((InvItem){id, count}));
+		item = VECMP_LAST_INSERT(&inv->items);
 	}
 	else {
 		item->count += count;
 		if(item->count < 0) item->count = 0;
 	}
 	
-	return VECMP_LAST_INSERT(&inv->items);
+	Totals_Delta(inv->totals, id, TOT_INV, item->count - before);
+	Inv_AdjustFill(inv, id, item->count - before);
+	
+	if(out) *out = item;
+	return item->count - before;
+}
+
+
+// items come into or go out of existence
+InvItem* Inv_AddItem(Inventory* inv, econid_t id, long count) {
+	InvItem* item;
+	long d = add_item(inv, id, count, &item);
+	
+	Totals_Delta(inv->totals, id, d > 0 ? TOT_CREATED : TOT_DESTROYED, d > 0 ? d : -d);
+	
+	return item;
+}
+
+
+// items arrive from a shipment
+InvItem* Inv_Receive(Inventory* inv, econid_t id, long count) {
+	InvItem* item;
+	long d = add_item(inv, id, count, &item);
+	
+	Totals_Delta(inv->totals, id, TOT_TRANSIT, -d);
+	
+	return item;
 }
 
 
 EscrowItem* Inv_AddEscrowItem(Inventory* inv, econid_t owner, econid_t id, long count) {
 	EscrowItem* item = Inv_GetEscrowItemP(inv, owner, id);
+	long before = item ? item->count : 0;
+	
 	if(!item) {
 		if(count < 0) count = 0;
 		VEC_PUSH(&inv->escrow, ((EscrowItem){owner, id, count}));
+		item = &VEC_TAIL(&inv->escrow);
 	}
 	else {
 		item->count += count;
 		if(item->count < 0) item->count = 0;
 	}
 	
-	return &VEC_TAIL(&inv->escrow);
+	long d = item->count - before;
+	Totals_Delta(inv->totals, id, TOT_ESCROW, d);
+	Inv_AdjustFill(inv, id, d);
+	Totals_Delta(inv->totals, id, d > 0 ? TOT_CREATED : TOT_DESTROYED, d > 0 ? d : -d);
+	
+	return item;
 }
 
 // returns number of items moved into escrow
 long Inv_MoveToEscrow(Inventory* inv, econid_t newOwner, econid_t item, long count) {
-	EscrowItem* es = Inv_AssertEscrowItemP(inv, newOwner, item);
 	InvItem* it = Inv_GetItemP(inv, item);
-	
 	if(!it || it->count <= 0) return 0;
 	
+	EscrowItem* es = Inv_AssertEscrowItemP(inv, newOwner, item);
+	
 	long toMove = MIN(count, it->count);
 	it->count -= toMove;
 	es->count += toMove;
 	
+	Totals_Delta(inv->totals, item, TOT_INV, -toMove);
+	Totals_Delta(inv->totals, item, TOT_ESCROW, toMove);
+	
 	return toMove;
 }
 
+// removes escrowed items to be shipped
+// the caller moves them from escrow to transit in the totals and takes
+//   them out of the fill, since this runs on market clearing threads
+// returns the number taken
+long Inv_TakeEscrow(Inventory* inv, econid_t owner, econid_t item, long count) {
+	EscrowItem* o = Inv_GetEscrowItemP(inv, owner, item);
+	if(!o || o->count <= 0 || count <= 0) return 0;
+	
+	long toTake = MIN(o->count, count);
+	o->count -= toTake;
+	
+	return toTake;
+}
+
+// puts escrowed items back with the rest of the inventory
+// returns the number returned
+long Inv_ReturnEscrow(Inventory* inv, econid_t owner, econid_t item, long count) {
+	EscrowItem* o = Inv_GetEscrowItemP(inv, owner, item);
+	if(!o || o->count <= 0 || count <= 0) return 0;
+	
+	long toReturn = MIN(o->count, count);
+	o->count -= toReturn;
+	
+	InvItem* it = Inv_AssertItemP(inv, item);
+	it->count += toReturn;
+	
+	Totals_Delta(inv->totals, item, TOT_ESCROW, -toReturn);
+	Totals_Delta(inv->totals, item, TOT_INV, toReturn);
+	
+	return toReturn;
+}
+
 // returns the number of items changed
 long Inv_EscrowChangeOwner(Inventory* inv, econid_t oldOwner, econid_t newOwner, econid_t item, long count) {
 	EscrowItem* o = Inv_AssertEscrowItemP(inv, oldOwner, item);
@@ -210,39 +400,201 @@ long Inv_EscrowChangeOwner(Inventory* inv, econid_t oldOwner, econid_t newOwner,
 
 
 
-void Entity_FuseInventories(Entity* e_core, Entity* e_extra) {
-	Inventory* invc = e_core->inv;
-	Inventory* inve = e_extra->inv;
+void InvTable_Init(InvTable* t, ItemTable* items) {
+	VECMP_INIT(&t->slots, 4096);
+	VEC_INIT(&t->freeSlots);
 	
-	// simple cases where one or both inv's are NULL
-	if(!invc && !inve) {
-		invc = Inv_New();
-		e_core->inv = invc;
-		e_extra->inv = invc;
-		return;
+	// the null handle
+	VECMP_INC(&t->slots);
+	memset(InvTable_Slot(t, 0), 0, sizeof(InvSlot));
+	
+	t->items = items;
+}
+
+void InvTable_Destroy(InvTable* t) {
+	for(invid_t h = 1; h < VECMP_LEN(&t->slots); h++) {
+		InvSlot* s = InvTable_Slot(t, h);
+		if(!VEC_LEN(&s->owners)) continue;
+		
+		Inv_Destroy(&s->inv);
+		VEC_FREE(&s->owners);
+	}
+	
+	VECMP_FREE(&t->slots);
+	VEC_FREE(&t->freeSlots);
+}
+
+
+// an empty inventory with no owners yet; the caller adds the first one
+invid_t InvTable_New(InvTable* t, CommodityTotals* totals) {
+	invid_t h;
+	
+	if(VEC_LEN(&t->freeSlots)) {
+		h = VEC_TAIL(&t->freeSlots);
+		VEC_LEN(&t->freeSlots)--;
+	}
+	else {
+		VECMP_INC(&t->slots);
+		h = VECMP_LAST_INS_INDEX(&t->slots);
+	}
+	
+	InvSlot* s = InvTable_Slot(t, h);
+	memset(s, 0, sizeof(*s));
+	Inv_Init(&s->inv);
+	s->inv.totals = totals;
+	s->inv.attrs = t->items;
+	
+	return h;
+}
+
+
+static void free_slot(InvTable* t, invid_t h) {
+	InvSlot* s = InvTable_Slot(t, h);
+	
+	Inv_Destroy(&s->inv);
+	VEC_FREE(&s->owners);
+	VEC_PUSH(&t->freeSlots, h);
+}
+
+
+// the entity's inventory, created on first use
+Inventory* Entity_AssertInv(Economy* ec, Entity* e) {
+	if(!e->inv) {
+		e->inv = InvTable_New(&ec->invs, &ec->totals);
+		VEC_PUSH(&InvTable_Slot(&ec->invs, e->inv)->owners, e->id);
 	}
 	
-	if(!invc) {
-		e_core->inv = inve;
+	return Entity_Inv(ec, e);
+}
+
+
+// gives up the entity's share of its inventory
+// the others sharing it keep the goods, with anything the entity had in
+//   escrow put back; when nobody is left the contents are destroyed
+void Entity_ReleaseInv(Economy* ec, Entity* e) {
+	if(!e->inv) return;
+	
+	InvSlot* s = InvTable_Slot(&ec->invs, e->inv);
+	Inventory* inv = &s->inv;
+	
+	VEC_EACHP(&s->owners, i, o) {
+		if(*o != e->id) continue;
+		
+		*o = VEC_TAIL(&s->owners);
+		VEC_LEN(&s->owners)--;
+		break;
+	}
+	
+	if(VEC_LEN(&s->owners)) {
+		VEC_EACHP(&inv->escrow, i, es) {
+			if(es->owner == e->id) Inv_ReturnEscrow(inv, e->id, es->item, es->count);
+		}
+	}
+	else {
+		VECMP_EACH(&inv->items, i, it) {
+			Totals_Delta(inv->totals, it->item, TOT_INV, -it->count);
+			Totals_Delta(inv->totals, it->item, TOT_DESTROYED, it->count);
+		}
+		VEC_EACHP(&inv->escrow, i, es) {
+			Totals_Delta(inv->totals, es->item, TOT_ESCROW, -es->count);
+			Totals_Delta(inv->totals, es->item, TOT_DESTROYED, es->count);
+		}
+		
+		free_slot(&ec->invs, e->inv);
+	}
+	
+	e->inv = 0;
+}
+
+
+// makes e_extra share e_core's inventory; everything already sharing
+//   e_extra's inventory comes along with it
+void Entity_FuseInventories(Economy* ec, Entity* e_core, Entity* e_extra) {
+	InvTable* t = &ec->invs;
+	
+	if(e_core->inv && e_core->inv == e_extra->inv) return;
+	
+	// simple cases where one or both inv's are missing
+	if(!e_core->inv && !e_extra->inv) {
+		Entity_AssertInv(ec, e_core);
+	}
+	
+	if(!e_core->inv) {
+		e_core->inv = e_extra->inv;
+		VEC_PUSH(&InvTable_Slot(t, e_core->inv)->owners, e_core->id);
 		return;
 	}
-	if(!inve) {
-		e_extra->inv = invc;
+	if(!e_extra->inv) {
+		e_extra->inv = e_core->inv;
+		VEC_PUSH(&InvTable_Slot(t, e_core->inv)->owners, e_extra->id);
 		return;
 	}
 	
-	// combine contents
+	invid_t hc = e_core->inv;
+	invid_t he = e_extra->inv;
+	Inventory* invc = InvTable_Get(t, hc);
+	Inventory* inve = InvTable_Get(t, he);
+	
+	// combine contents; re-adding counts as creation, so take the
+	//   originals out of the totals first
 	VECMP_EACH(&inve->items, i, it) {
+		Totals_Delta(inve->totals, it->item, TOT_INV, -it->count);
+		Totals_Delta(inve->totals, it->item, TOT_CREATED, -it->count);
 		Inv_AddItem(invc, it->item, it->count);
 	}
 	VEC_EACHP(&inve->escrow, i, eit) {
+		Totals_Delta(inve->totals, eit->item, TOT_ESCROW, -eit->count);
+		Totals_Delta(inve->totals, eit->item, TOT_CREATED, -eit->count);
 		Inv_AddEscrowItem(invc,  eit->owner, eit->item, eit->count);
 	}
 	
-	Inv_Destroy(inve);
-	free(inve);
+	// every owner of the old inventory moves over
+	InvSlot* se = InvTable_Slot(t, he);
+	InvSlot* sc = InvTable_Slot(t, hc);
+	VEC_EACH(&se->owners, i, o) {
+		Econ_GetEntity(ec, o)->inv = hc;
+		VEC_PUSH(&sc->owners, o);
+	}
+	
+	free_slot(t, he);
+}
+
+
+// limits the entity's inventory, and everyone sharing it, to the given
+//   volume and weight; 0 for unlimited
+// goods already over the limit stay, nothing more is added until they leave
+void Entity_SetStorage(Economy* ec, Entity* e, float maxVolume, float maxWeight) {
+	Inventory* inv = Entity_AssertInv(ec, e);
 	
-	e_extra->inv = invc;
+	inv->store.maxVolume = maxVolume;
+	inv->store.maxWeight = maxWeight;
 }
 
 
+// copies the entity's storageVolume and storageWeight comps onto its
+//   inventory; call whenever either changes
+// a missing comp means unlimited; entities sharing an inventory share
+//   whichever limits were applied last
+void Econ_StorageUpdate(Economy* ec, Entity* e) {
+	double v = Econ_CompNumber(ec, e, ec->storageVolumeComp, 0);
+	double w = Econ_CompNumber(ec, e, ec->storageWeightComp, 0);
+	
+	// nothing to limit, and no reason to create an inventory
+	if(!e->inv && v <= 0 && w <= 0) return;
+	
+	Entity_SetStorage(ec, e, MAX(0, v), MAX(0, w));
+}
+
+
+void Econ_BuildStorage(Economy* ec) {
+	ec->storageVolumeComp = Econ_CompTypeFromName(ec, "storageVolume");
+	ec->storageWeightComp = Econ_CompTypeFromName(ec, "storageWeight");
+	if(ec->storageVolumeComp < 0 && ec->storageWeightComp < 0) return;
+	
+	VECMP_EACH(&ec->entities, i, e) {
+		if(e->dead) continue;
+		if(!Entity_GetComp(e, ec->storageVolumeComp) && !Entity_GetComp(e, ec->storageWeightComp)) continue;
+		
+		Econ_StorageUpdate(ec, e);
+	}
+}
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+
+#include "econ.h"
+#include "worldgen.h"
+
+FILE* _log;
+
+
+
+static void usage(void) {
+	fprintf(stderr,
+		"usage: genworld [options]\n"
+		"  -t path   template world (defs.json)\n"
+		"  -o path   output file (stdout)\n"
+		"  -s n      seed (1)\n"
+		"  -f n      forests\n"
+		"  -c n      logging camps\n"
+		"  -k n      market sinks\n"
+		"  -m n      mines\n"
+		"  -p n      people\n"
+		"  -l n      lowest sell price\n"
+		"  -h n      highest sell price\n"
+	);
+}
+
+
+int main(int argc, char* argv[]) {
+	char* tmplPath = "defs.json";
+	char* outPath = NULL;
+
+	WorldGenOpts o;
+	WorldGen_DefaultOpts(&o);
+
+	int opt;
+	while((opt = getopt(argc, argv, "t:o:s:f:c:k:m:p:l:h:")) != -1) {
+		switch(opt) {
+			case 't': tmplPath = optarg; break;
+			case 'o': outPath = optarg; break;
+			case 's': o.seed = strtoull(optarg, NULL, 10); break;
+			case 'f': o.forests = atol(optarg); break;
+			case 'c': o.camps = atol(optarg); break;
+			case 'k': o.sinks = atol(optarg); break;
+			case 'm': o.mines = atol(optarg); break;
+			case 'p': o.people = atol(optarg); break;
+			case 'l': o.minPrice = atol(optarg); break;
+			case 'h': o.maxPrice = atol(optarg); break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	_log = fopen("/tmp/genworld.log", "w");
+
+	Economy ec;
+	Economy_init(&ec);
+	if(Economy_LoadConfig(&ec, tmplPath)) {
+		fprintf(stderr, "Failed to load template '%s'\n", tmplPath);
+		return 1;
+	}
+
+	int ret = outPath ? WorldGen_WritePath(&ec, &o, outPath) : WorldGen_Write(&ec, &o, stdout);
+
+	fclose(_log);
+
+	return ret;
+}
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "econ.h"
+
+
+
+
+void Items_Init(ItemTable* it) {
+	memset(it, 0, sizeof(*it));
+	VEC_INIT(&it->names);
+	HT_init(&it->nameLookup, 1024);
+	
+	// name id 0 is the empty name
+	VEC_INIT(&it->nameItems);
+	VEC_PUSH(&it->names, strdup(""));
+	VEC_PUSH(&it->nameItems, ITEM_NONE);
+}
+
+
+void Items_Destroy(ItemTable* it) {
+	free(it->ids);
+	free(it->weight);
+	free(it->volume);
+	free(it->nameId);
+	free(it->index);
+	
+	VEC_EACH(&it->names, i, n) free(n);
+	VEC_FREE(&it->names);
+	VEC_FREE(&it->nameItems);
+	HT_destroy(&it->nameLookup);
+}
+
+
+// slow path of Items_Assert
+itemidx_t Items_Add(ItemTable* it, econid_t id) {
+	if(id >= it->indexAlloc) {
+		econid_t n = MAX(256, it->indexAlloc);
+		while(n <= id) n *= 2;
+		
+		it->index = realloc(it->index, sizeof(*it->index) * n);
+		memset(it->index + it->indexAlloc, 0xff, sizeof(*it->index) * (n - it->indexAlloc));
+		it->indexAlloc = n;
+	}
+	
+	if(it->count >= it->alloc) {
+		it->alloc = MAX(64, it->alloc * 2);
+		it->ids = realloc(it->ids, sizeof(*it->ids) * it->alloc);
+		it->weight = realloc(it->weight, sizeof(*it->weight) * it->alloc);
+		it->volume = realloc(it->volume, sizeof(*it->volume) * it->alloc);
+		it->nameId = realloc(it->nameId, sizeof(*it->nameId) * it->alloc);
+	}
+	
+	itemidx_t x = it->count++;
+	it->ids[x] = id;
+	it->weight[x] = 0;
+	it->volume[x] = 0;
+	it->nameId[x] = 0;
+	it->index[id] = x;
+	
+	return x;
+}
+
+
+static uint32_t intern_name(ItemTable* it, char* name) {
+	if(!name || !name[0]) return 0;
+	
+	uint32_t n;
+	if(!HT_get(&it->nameLookup, name, &n)) return n;
+	
+	n = VEC_LEN(&it->names);
+	VEC_PUSH(&it->names, strdup(name));
+	VEC_PUSH(&it->nameItems, ITEM_NONE);
+	HT_set(&it->nameLookup, VEC_TAIL(&it->names), n);
+	
+	return n;
+}
+
+
+// registers every Item entity and copies its attributes into the columns
+// rerun after items are created or changed; existing indices stay put
+void Econ_BuildItems(Economy* ec) {
+	ItemTable* it = &ec->items;
+	
+	int itemType = Economy_EntityType(ec, "Item");
+	EntityDef* ed = itemType >= 0 ? Economy_GetEntityDef(ec, itemType) : NULL;
+	if(!ed) return;
+	
+	int nameComp = Econ_CompTypeFromName(ec, "name");
+	int weightComp = Econ_CompTypeFromName(ec, "weight");
+	int volumeComp = Econ_CompTypeFromName(ec, "volume");
+	
+	CompDef* nameDef = nameComp >= 0 ? Econ_GetCompDef(ec, nameComp) : NULL;
+	if(nameDef && (nameDef->type != CT_str || nameDef->isArray)) nameComp = -1;
+	
+	VEC_EACH(&ed->instances, i, id) {
+		Entity* e = Econ_GetEntity(ec, id);
+		itemidx_t x = Items_Assert(it, id);
+		
+		char** n = nameComp >= 0 ? Entity_Get_str(ec, e, nameComp) : NULL;
+		
+		it->weight[x] = Econ_CompNumber(ec, e, weightComp, 0);
+		it->volume[x] = Econ_CompNumber(ec, e, volumeComp, 0);
+		it->nameId[x] = intern_name(it, n ? *n : NULL);
+	}
+	
+	// names can change between builds, so the reverse lookup is redone;
+	//   the lowest index wins when several items share a name
+	VEC_EACHP(&it->nameItems, i, ni) *ni = ITEM_NONE;
+	for(itemidx_t x = it->count; x-- > 0;) {
+		VEC_ITEM(&it->nameItems, it->nameId[x]) = x;
+	}
+	
+	// what each conversion does to a warehouse's fill
+	VECMP_EACH(&ec->conversions, ci, c) {
+		double v = 0, w = 0;
+		
+		for(int k = 0; k < c->inputCnt + c->outputCnt; k++) {
+			InvItem* io = k < c->inputCnt ? &c->inputs[k] : &c->outputs[k - c->inputCnt];
+			itemidx_t x = Items_Index(it, io->item);
+			if(x == ITEM_NONE) continue;
+			
+			long n = k < c->inputCnt ? -io->count : io->count;
+			v += (double)it->volume[x] * n;
+			w += (double)it->weight[x] * n;
+		}
+		
+		c->netVolume = v;
+		c->netWeight = w;
+	}
+}
@@ -0,0 +1,57 @@
+// dense table of item attributes
+//   items are entities of the "Item" type, but capacity and freight math
+//   reads these columns instead of scanning components; every item id also
+//   gets a dense index so per-item arrays don't have to span all entity ids
+
+
+
+typedef uint32_t itemidx_t;
+#define ITEM_NONE ((itemidx_t)-1)
+
+
+typedef struct ItemTable {
+	itemidx_t count, alloc;
+	
+	// columns, by dense index
+	econid_t* ids;
+	float* weight;
+	float* volume;
+	uint32_t* nameId; // into names
+	
+	// distinct item names
+	VEC(char*) names;
+	VEC(itemidx_t) nameItems; // first item with each name, ITEM_NONE if unused
+	HT(uint32_t) nameLookup;
+	
+	// entity id to dense index, ITEM_NONE for anything never seen as an item
+	itemidx_t* index;
+	econid_t indexAlloc;
+} ItemTable;
+
+
+
+
+void Items_Init(ItemTable* it);
+void Items_Destroy(ItemTable* it);
+itemidx_t Items_Add(ItemTable* it, econid_t id);
+
+
+static inline itemidx_t Items_Index(ItemTable* it, econid_t id) {
+	return id < it->indexAlloc ? it->index[id] : ITEM_NONE;
+}
+
+// indices are never reused or moved, so they can key flat arrays
+// only call from serial phases; new items have no attributes until
+//   Econ_BuildItems runs
+static inline itemidx_t Items_Assert(ItemTable* it, econid_t id) {
+	itemidx_t x = Items_Index(it, id);
+	return x != ITEM_NONE ? x : Items_Add(it, id);
+}
+
+static inline char* Items_Name(ItemTable* it, itemidx_t x) {
+	return VEC_ITEM(&it->names, it->nameId[x]);
+}
+
+
+struct Economy;
+void Econ_BuildItems(struct Economy* ec);
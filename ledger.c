@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "econ.h"
+
+
+
+
+void Ledger_Init(Ledger* l) {
+	memset(l, 0, sizeof(*l));
+	
+	VEC_INIT(&l->journal);
+	VEC_INIT(&l->touched);
+}
+
+
+void Ledger_Destroy(Ledger* l) {
+	free(l->balance);
+	free(l->delta);
+	free(l->flags);
+	
+	VEC_FREE(&l->journal);
+	VEC_FREE(&l->touched);
+}
+
+
+// makes sure ids below accounts are valid
+void Ledger_Reserve(Ledger* l, econid_t accounts) {
+	if(accounts <= l->accounts) return;
+	
+	econid_t n = MAX(1024, l->accounts);
+	while(n < accounts) n *= 2;
+	
+	l->balance = realloc(l->balance, sizeof(*l->balance) * n);
+	l->delta = realloc(l->delta, sizeof(*l->delta) * n);
+	l->flags = realloc(l->flags, sizeof(*l->flags) * n);
+	
+	econid_t add = n - l->accounts;
+	memset(l->balance + l->accounts, 0, sizeof(*l->balance) * add);
+	memset(l->delta + l->accounts, 0, sizeof(*l->delta) * add);
+	memset(l->flags + l->accounts, 0, sizeof(*l->flags) * add);
+	
+	l->accounts = n;
+}
+
+
+void Ledger_SetExternal(Ledger* l, econid_t id) {
+	Ledger_Reserve(l, id + 1);
+	l->flags[id] |= LEDGERF_EXTERNAL;
+}
+
+
+money_t Ledger_Balance(Ledger* l, econid_t id) {
+	return id < l->accounts ? l->balance[id] : 0;
+}
+
+
+// creates or destroys money outside of the journal, as when loading
+// returns 1 if the balance would leave the allowed range
+int Ledger_Mint(Ledger* l, econid_t id, money_t amount) {
+	Ledger_Reserve(l, id + 1);
+	
+	money_t nb;
+	if(__builtin_add_overflow(l->balance[id], amount, &nb) || nb > ECON_CASHMAX || nb < -ECON_CASHMAX) {
+		return 1;
+	}
+	
+	l->balance[id] = nb;
+	l->supply += amount;
+	
+	return 0;
+}
+
+
+void Ledger_Post(Ledger* l, econid_t from, econid_t to, money_t amount) {
+	if(amount <= 0 || from == to) return;
+	
+	VEC_PUSH(&l->journal, ((LedgerEntry){from, to, amount}));
+}
+
+
+
+
+static void touch(Ledger* l, econid_t id) {
+	if(l->flags[id] & LEDGERF_TOUCHED) return;
+	
+	l->flags[id] |= LEDGERF_TOUCHED;
+	VEC_PUSH(&l->touched, id);
+}
+
+
+static int balance_ok(Ledger* l, econid_t id, money_t b) {
+	if(b > ECON_CASHMAX) return 0;
+	if(b < 0 && !(l->flags[id] & LEDGERF_EXTERNAL)) return 0;
+	if(b < -ECON_CASHMAX) return 0;
+	return 1;
+}
+
+
+// applies the journal, then empties it
+// returns the number of rejected postings
+long Ledger_Settle(Ledger* l) {
+	VEC_TRUNC(&l->touched);
+	l->posted = 0;
+	l->rejected = 0;
+	
+	if(!VEC_LEN(&l->journal)) return 0;
+	
+	econid_t maxID = 0;
+	VEC_EACHP(&l->journal, i, j) {
+		maxID = MAX(maxID, MAX(j->from, j->to));
+	}
+	Ledger_Reserve(l, maxID + 1);
+	
+	// fast path: net the postings per account, then check each account once
+	int ok = 1;
+	VEC_EACHP(&l->journal, i, j) {
+		touch(l, j->from);
+		touch(l, j->to);
+		
+		ok &= !__builtin_sub_overflow(l->delta[j->from], j->amount, &l->delta[j->from]);
+		ok &= !__builtin_add_overflow(l->delta[j->to], j->amount, &l->delta[j->to]);
+	}
+	
+	VEC_EACH(&l->touched, i, id) {
+		money_t nb;
+		if(!ok) break;
+		ok = !__builtin_add_overflow(l->balance[id], l->delta[id], &nb) && balance_ok(l, id, nb);
+	}
+	
+	if(ok) {
+		VEC_EACH(&l->touched, i, id) {
+			l->balance[id] += l->delta[id];
+		}
+		l->posted = VEC_LEN(&l->journal);
+	}
+	else {
+		// some account went out of range somewhere in the batch;
+		//   replay it in order, refusing the postings that don't fit
+		VEC_EACHP(&l->journal, i, j) {
+			money_t nf, nt;
+			if(__builtin_sub_overflow(l->balance[j->from], j->amount, &nf) || !balance_ok(l, j->from, nf)
+				|| __builtin_add_overflow(l->balance[j->to], j->amount, &nt) || !balance_ok(l, j->to, nt)) {
+				l->rejected++;
+				continue;
+			}
+			
+			l->balance[j->from] = nf;
+			l->balance[j->to] = nt;
+			l->posted++;
+		}
+	}
+	
+	VEC_EACH(&l->touched, i, id) {
+		l->delta[id] = 0;
+		l->flags[id] &= ~LEDGERF_TOUCHED;
+	}
+	
+	VEC_TRUNC(&l->journal);
+	
+	return l->rejected;
+}
+
+
+// returns 0 if the balances still add up to the money supply
+int Ledger_Check(Ledger* l) {
+	money_t sum = 0;
+	for(econid_t i = 0; i < l->accounts; i++) {
+		sum += l->balance[i];
+	}
+	
+	return sum != l->supply;
+}
+
+
+
+
+// seeds the balances from the cash components
+void Econ_BuildLedger(Economy* ec) {
+	Ledger* l = &ec->ledger;
+	
+	ec->cashComp = Econ_CompTypeFromName(ec, "cash");
+	if(ec->cashComp < 0) return;
+	
+	CompDef* cd = Econ_GetCompDef(ec, ec->cashComp);
+	if(cd->type != CT_int || cd->isArray) {
+		LOG("Ledger: 'cash' must be a plain int component");
+		ec->cashComp = -1;
+		return;
+	}
+	
+	Ledger_Reserve(l, ec->entitySlots);
+	
+	VECMP_EACH(&ec->entities, i, e) {
+		if(e->dead) continue;
+		
+		int64_t* cash = Entity_Get_int(ec, e, ec->cashComp);
+		if(!cash) continue;
+		
+		money_t cur = l->balance[e->id];
+		if(Ledger_Mint(l, e->id, *cash - cur)) {
+			LOG("Cash out of range on entity %u: %ld", e->id, (long)*cash);
+		}
+	}
+}
+
+
+// makes the balance match the cash component again, minting or destroying the difference
+// used when entities are created, destroyed, or have their cash set outright
+void Econ_LedgerReset(Economy* ec, Entity* e) {
+	Ledger* l = &ec->ledger;
+	
+	money_t target = 0;
+	if(!e->dead && ec->cashComp >= 0) {
+		int64_t* cash = Entity_Get_int(ec, e, ec->cashComp);
+		if(cash) target = *cash;
+	}
+	
+	if(Ledger_Mint(l, e->id, target - Ledger_Balance(l, e->id))) {
+		LOG("Cash out of range on entity %u: %ld", e->id, (long)target);
+	}
+}
+
+
+// settles the tick's postings and copies the new balances back into the cash components
+void Econ_SettleLedger(Economy* ec) {
+	Ledger* l = &ec->ledger;
+	
+	long rejected = Ledger_Settle(l);
+	if(rejected) LOG("tick %u: %ld ledger postings rejected", ec->tick, rejected);
+	
+	if(ec->cashComp < 0) return;
+	
+	VEC_EACH(&l->touched, i, id) {
+		if(id >= ec->entitySlots) continue;
+		
+		Entity* e = Econ_GetEntity(ec, id);
+		if(e->dead) continue;
+		
+		int64_t* cash = Entity_Get_int(ec, e, ec->cashComp);
+		if(cash) *cash = l->balance[id];
+	}
+}
+
@@ -0,0 +1,55 @@
+
+
+// double entry cash ledger
+//   balances live in a dense array indexed by entity id; postings made during
+//   a tick are journaled and settled together at the end of it
+
+
+
+typedef struct LedgerEntry {
+	econid_t from, to;
+	money_t amount;
+} LedgerEntry;
+
+
+// may go negative; stands for money coming from outside the world
+#define LEDGERF_EXTERNAL 0x01
+#define LEDGERF_TOUCHED  0x02
+
+typedef struct Ledger {
+	econid_t accounts; // length of the arrays below
+	money_t* balance;
+	money_t* delta; // settlement scratch, always zero between settlements
+	unsigned char* flags;
+	
+	// sum of every balance; only Ledger_Mint changes it
+	money_t supply;
+	
+	VEC(LedgerEntry) journal;
+	
+	// results of the last settlement
+	VEC(econid_t) touched;
+	long posted;
+	long rejected;
+} Ledger;
+
+
+
+
+void Ledger_Init(Ledger* l);
+void Ledger_Destroy(Ledger* l);
+void Ledger_Reserve(Ledger* l, econid_t accounts);
+
+void Ledger_SetExternal(Ledger* l, econid_t id);
+int Ledger_Mint(Ledger* l, econid_t id, money_t amount);
+money_t Ledger_Balance(Ledger* l, econid_t id);
+
+void Ledger_Post(Ledger* l, econid_t from, econid_t to, money_t amount);
+long Ledger_Settle(Ledger* l);
+int Ledger_Check(Ledger* l);
+
+struct Economy;
+void Econ_BuildLedger(struct Economy* ec);
+void Econ_SettleLedger(struct Economy* ec);
+void Econ_LedgerReset(struct Economy* ec, struct Entity* e);
+
@@ -11,17 +11,15 @@
 
 
 #include "econ.h"
+#include "sim.h"
 
 FILE* _log;
 
 
 
-static void print_comp_val(Economy* ec, Comp* c);
-static void print_entity(Economy* ec, Entity* e, int width, int offset, char** cols);
-static void print_entities_type(
-	Economy* ec, int type, int voffset,
-	int width, char** cols, int hoffset
-);
+static void print_cell(SnapCell* sc);
+static void print_entity(SnapCell* row, int width);
+static void print_entities_type(Snapshot* s, int width);
 
 
 
@@ -31,10 +29,19 @@ int main(int argc, char* argv[]) {
 	int ch;
 	
 	_log = fopen("/tmp/econsim.log", "w");
+	
+	// econsim [ticks per second, 0 for unlimited] [ticks per ui snapshot] [world file]
+	int tickRate = argc > 1 ? atoi(argv[1]) : 10;
+	int publishEvery = argc > 2 ? atoi(argv[2]) : 1;
+	char* worldPath = argc > 3 ? argv[3] : "defs.json";
 
 	Economy ec;
 	
 	Economy_init(&ec);
+	if(Economy_LoadConfig(&ec, worldPath)) {
+		fprintf(stderr, "Failed to load world '%s'\n", worldPath);
+		return 1;
+	}
 
 	
 	// ncurses stuff
@@ -50,71 +57,55 @@ int main(int argc, char* argv[]) {
     assume_default_colors( COLOR_WHITE, COLOR_BLACK | A_BOLD);
 	
 	
-	
-	
-	/*
-	Economy_AddActor(&ec, "Nobody", 100);
-	Economy_AddActor(&ec, "A", 100);
-	Economy_AddActor(&ec, "B", 100);
-	Economy_AddActor(&ec, "C", 100);
-	Economy_AddActor(&ec, "D", 100);
-	Economy_AddActor(&ec, "E", 100);
-	
-	Economy_AddCashflow(&ec, 30, 0, 1, 1, "Pay me");
-	
-	for(int i = 0; g_assets[i].id != UINT32_MAX; i++) {
-		Economy_AddAsset(&ec, &g_assets[i]);
-	}
-	
-	*/
-	
-	int tab = 1;
+	int tab = 0;
 	int scrollh = 0;
 	int scrollv = 0;
 	
 	
-	typedef struct View {
-		char* name;
-		char* dispName;
-		char** cols;
-		
-	} View;
-	
 	View views[] = {
 		{.name = "Forest", .dispName = "Forests", .cols = (char*[]){"name", "!Tree", "!Log", "!Board", "!Sawdust", NULL} },
 		{.name = "Person", .dispName = "People", .cols = (char*[]){"name", "cash", NULL} },
 		{.name = "Mine", .dispName = "Mines", .cols = (char*[]){"name", "!Iron Ore", NULL} },
+		{.name = "Item", .dispName = "World Totals", .cols = (char*[]){"name", "#inv", "#escrow", "#transit", "#consumed", NULL} },
+		{.name = "Item", .dispName = "Prices", .cols = (char*[]){"name", "$last", "$vwap", "$volume", "$high", "$low", NULL} },
+		{.name = "Person", .dispName = "Richest", .cols = (char*[]){"name", "cash", NULL}, .sortBy = "cash", .desc = 1 },
+		{.name = "Item", .dispName = "Most Traded", .cols = (char*[]){"name", "$volume", "$vwap", "$open", "$close", NULL}, .sortBy = "$volume", .desc = 1 },
 		
 		{.name = NULL},
 	};
 	
 	
-	for(int n = 1; n <= 1000; ) {
-		
+	// from here on only the sim thread touches ec
+	SimThread sim;
+	Sim_Start(&sim, &ec, views, tickRate, publishEvery);
+	
+	
+	while(1) {
+		Snapshot* snap = Sim_GetSnapshot(&sim);
 		
 		erase();
 		
-		mvprintw(0, 1, "Tick %d\n", n);
-		mvprintw(0, 20, "%s:\n", views[tab].dispName);
+		mvprintw(0, 1, "Tick %d\n", snap->tick);
+		mvprintw(0, 20, "%s:\n", views[snap->tab].dispName);
+		mvprintw(0, 40, "%s %.1f/%d tps\n",
+			atomic_load(&sim.paused) ? "paused" : "running",
+			snap->ticksPerSec, atomic_load(&sim.tickRate)
+		);
 		
 		mvprintw(1, 2, "char %d, %d, %d", scrollh, scrollv, tab);
+		if(views[snap->tab].sortBy) {
+			mvprintw(1, 30, "%ld ranked, total %.0f", snap->matched, snap->sortSum);
+		}
 		
+		print_entities_type(snap, 20);
 		
-		int entType = Economy_EntityType(&ec, views[tab].name);
-		
-		print_entities_type(&ec, entType, scrollv, 20, views[tab].cols, scrollh);
-		
-		
+		refresh();
 		
 		
-		while(1) {
-			ch = getch();
-			if(ch == -1) {
-				usleep(10000);
-				continue;
-			}
-			
-			break;
+		ch = getch();
+		if(ch == -1) {
+			usleep(16000);
+			continue;
 		}
 		
 		
@@ -143,13 +134,30 @@ int main(int argc, char* argv[]) {
 			scrollv = MAX(0, scrollv + 1);
 		}
 		
+		Sim_SetView(&sim, tab, scrollh, scrollv);
+		
 		if(ch == ' ') {
-			Economy_tick(&ec);
-			n++;
+			atomic_fetch_add(&sim.steps, 1);
+		}
+		else if(ch == 'r') {
+			atomic_fetch_xor(&sim.paused, 1);
+		}
+		else if(ch == '+') {
+			int r = atomic_load(&sim.tickRate);
+			atomic_store(&sim.tickRate, r ? r * 2 : 0);
+		}
+		else if(ch == '-') {
+			int r = atomic_load(&sim.tickRate);
+			atomic_store(&sim.tickRate, r ? MAX(1, r / 2) : 1024);
+		}
+		else if(ch == '0') {
+			atomic_store(&sim.tickRate, 0);
 		}
 	}
 	
 	
+	Sim_Stop(&sim);
+	Publisher_Close(ec.publisher);
 	
 	endwin();
 	
@@ -161,56 +169,34 @@ int main(int argc, char* argv[]) {
 
 
 
-static void print_comp_val(Economy* ec, Comp* c) {
-	if(!c) return;
-	
-	// TODO: support arrays
-	CompDef* cd = Econ_GetCompDef(ec, c->type);
-	switch(cd->type) {
-		default:
-			fprintf(stderr, "unknown component type: %d\n", cd->type);
-			exit(1);
-			
-		case CT_int: printw("%ld", c->n); break;
-		case CT_float: printw("%f", c->d); break;
-		case CT_str: printw("%s", c->str); break;
-		case CT_id: printw("%ld", c->id); break;
-		case CT_itemRate: printw("%ld:%f", c->itemRate->item, c->itemRate->rate); break;
+static void print_cell(SnapCell* sc) {
+	switch(sc->kind) {
+		case SNAP_NONE: break;
+		case SNAP_INT: printw("%ld", sc->n); break;
+		case SNAP_FLOAT: printw("%f", sc->d); break;
+		case SNAP_STR: printw("%s", sc->str); break;
+		case SNAP_ID: printw("%u", sc->id); break;
+		case SNAP_ITEMRATE: printw("%u:%f", sc->itemRate.item, sc->itemRate.rate); break;
+		case SNAP_INV: printw("%ld", sc->inv.count); break;
+		case SNAP_INVESCROW: printw("%ld/%ld", sc->inv.count, sc->inv.escrow); break;
 	}
 	
+	if(sc->more > 0) printw(" +%d", sc->more);
+
 }
 
 
-static void print_entity(Economy* ec, Entity* e, int width, int offset, char** cols) {
+static void print_entity(SnapCell* row, int width) {
 	int x, y;
 ////	int rows, cols;
 //	getmaxyx(stdscr, rows, cols);
 	getyx(stdscr, y, x);
 		
 	
-	for(int i = 0, n = 0; cols[i] && n < 6; i++) {
-		if(i < offset) continue;
-		
+	for(int n = 0; n < SNAP_COLS; n++) {
 		move(y, x + (width * n));
 		
-		if(cols[i][0] == '!') {
-//			LOG("inv");
-			int itemid = Econ_FindItem(ec, cols[i] + 1);
-//			LOG(" - %d", itemid);
-			InvItem* item = Inv_GetItemP(e->inv, itemid);
-			EscrowItem* eitem = Inv_GetEscrowItemP(e->inv, e->id, itemid);
-//			LOG(" -- %p", item);
-			if(eitem) 
-				printw("%ld/%ld", item->count, eitem->count);
-			else if(item)
-				printw("%ld", item->count);
-		}
-		else {
-			Comp* c = Entity_GetCompName(ec, e, cols[i]);
-			print_comp_val(ec, c);
-		}
-		
-		n++;
+		print_cell(&row[n]);
 	}
 }
 
@@ -219,21 +205,12 @@ static void print_entity(Economy* ec, Entity* e, int width, int offset, char** c
 
 
 
-static void print_entities_type(
-	Economy* ec, int type, int voffset,
-	int width, char** cols, int hoffset
-) {
+static void print_entities_type(Snapshot* s, int width) {
 	
-	int n = 0;
-	VECMP_EACH(&ec->entities, i, e) {
-		if(e->type != type) continue;
-		if(i < voffset) continue;
-		
-		move(n++ + 3, 2);		
-		
-		print_entity(ec, e, width, hoffset, cols); 
+	for(int n = 0; n < s->rowCnt; n++) {
+		move(n + 3, 2);
 		
-		if(n > 20) break;
+		print_entity(s->cells[n], width); 
 	}
 	
 }
@@ -18,12 +18,37 @@ Market* Market_New() {
 }
 
 void Market_Init(Market* m) {
-	VEC_INIT(&m->sells);
+	VEC_INIT(&m->bookList);
+	VEC_INIT(&m->fills);
 	VECMP_INIT(&m->sinks, 4096);
+	
+	for(int i = 0; i < MARKET_WHEEL_SIZE; i++) {
+		VEC_INIT(&m->wheel[i]);
+	}
+	VEC_INIT(&m->farExpiries);
+	
+	Market_SetWorkers(m, 1);
 }
 
 void Market_Destroy(Market* m) {
-	VEC_FREE(&m->sells);
+	VEC_EACH(&m->bookList, i, b) {
+		VEC_FREE(&b->orders);
+		free(b);
+	}
+	VEC_FREE(&m->bookList);
+	free(m->books);
+	
+	for(int i = 0; i < m->queueCnt; i++) {
+		VEC_FREE(&m->queues[i]);
+	}
+	free(m->queues);
+	
+	for(int i = 0; i < MARKET_WHEEL_SIZE; i++) {
+		VEC_FREE(&m->wheel[i]);
+	}
+	VEC_FREE(&m->farExpiries);
+	
+	VEC_FREE(&m->fills);
 	VECMP_FREE(&m->sinks);
 }
 
@@ -33,32 +58,328 @@ void Market_Free(Market* m) {
 }
 
 
+// one staging queue per worker thread; only call while nothing is staged
+void Market_SetWorkers(Market* m, int workers) {
+	for(int i = 0; i < m->queueCnt; i++) {
+		VEC_FREE(&m->queues[i]);
+	}
+	free(m->queues);
+	
+	m->queueCnt = MAX(1, workers);
+	m->queues = calloc(1, sizeof(*m->queues) * m->queueCnt);
+	for(int i = 0; i < m->queueCnt; i++) {
+		VEC_INIT(&m->queues[i]);
+	}
+}
+
+
+// NULL if nothing was ever offered for the item
+static MarketBook* find_book(Market* m, econid_t item) {
+	itemidx_t x = Items_Index(m->items, item);
+	return x < m->bookAlloc ? m->books[x] : NULL;
+}
+
+MarketBook* Market_GetBook(Market* m, econid_t item) {
+	MarketBook* b = find_book(m, item);
+	if(b) return b;
+	
+	itemidx_t x = Items_Assert(m->items, item);
+	if(x >= m->bookAlloc) {
+		itemidx_t n = MAX(64, m->bookAlloc);
+		while(n <= x) n *= 2;
+		
+		m->books = realloc(m->books, sizeof(*m->books) * n);
+		memset(m->books + m->bookAlloc, 0, sizeof(*m->books) * (n - m->bookAlloc));
+		m->bookAlloc = n;
+	}
+	
+	b = calloc(1, sizeof(*b));
+	b->item = item;
+	VEC_INIT(&b->orders);
+	
+	m->books[x] = b;
+	VEC_PUSH(&m->bookList, b);
+	
+	return b;
+}
+
+
+static int order_cmp(const void* a, const void* b) {
+	const MarketOrder* x = a;
+	const MarketOrder* y = b;
+	
+	if(x->price != y->price) return x->price < y->price ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+
+// stamps the order with its expiry tick and puts it on the wheel
+static void schedule_expiry(Market* m, MarketOrder* o) {
+	if(!m->orderTTL) return;
+	
+	o->expires = m->now + m->orderTTL;
+	
+	MarketExpiry x = {
+		.item = o->item,
+		.price = o->price,
+		.seq = o->seq,
+		.expires = o->expires,
+	};
+	
+	if(m->orderTTL < MARKET_WHEEL_SIZE) {
+		VEC_PUSH(&m->wheel[x.expires & (MARKET_WHEEL_SIZE - 1)], x);
+	}
+	else {
+		VEC_PUSH(&m->farExpiries, x);
+	}
+}
+
+
+// binary search on the book's sort key; NULL if the order is gone
+static MarketOrder* find_order(MarketBook* b, money_t price, uint64_t seq) {
+	MarketOrder key = {.price = price, .seq = seq};
+	return bsearch(&key, VEC_DATA(&b->orders), VEC_LEN(&b->orders), sizeof(MarketOrder), order_cmp);
+}
+
+
+// drops filled orders, and those of destroyed sellers, keeping the book order
+static void compact_book(MarketBook* b, int checkDead) {
+	intptr_t n = 0;
+	VEC_EACHP(&b->orders, i, o) {
+		if(o->qtyAvail <= 0) continue;
+		if(checkDead && o->seller->dead) continue;
+		
+		VEC_ITEM(&b->orders, n++) = *o;
+	}
+	
+	VEC_LEN(&b->orders) = n;
+	b->emptied = 0;
+}
+
+
+void Market_Compact(Market* m) {
+	VEC_EACH(&m->bookList, i, b) {
+		if(b->emptied) compact_book(b, 0);
+	}
+}
+
+
+// drops the orders of destroyed sellers
+void Market_RemoveDeadSellers(Market* m) {
+	VEC_EACH(&m->bookList, i, b) {
+		compact_book(b, 1);
+	}
+}
+
+
+// places an order right away; use Market_StageSellOrder from parallel phases
 void Market_AddSellOrder(Market* m, Entity* seller, econid_t item, long qty, money_t price) {
 	if(price < 1) price = 1; // HACK
 	
-	long moved = Inv_MoveToEscrow(seller->inv, seller->id, item, qty);
+	long moved = Inv_MoveToEscrow(InvTable_Get(m->invs, seller->inv), seller->id, item, qty);
+	if(moved <= 0) return;
 	
-	VEC_PUSH(&m->sells, ((MarketOrder){
+	MarketOrder o = {
 		.seller = seller,
 		.item = item,
 		.qtyAvail = moved,
 		.minQty = 0,
 		.price = price,
+		.seq = m->seq++,
+	};
+	schedule_expiry(m, &o);
+	
+	MarketBook* b = Market_GetBook(m, item);
+	
+	// new orders are the youngest, so they go after everything at their price
+	intptr_t at = VEC_LEN(&b->orders);
+	while(at > 0 && VEC_ITEM(&b->orders, at - 1).price > price) at--;
+	
+	VEC_PUSH(&b->orders, o);
+	memmove(&VEC_ITEM(&b->orders, at + 1), &VEC_ITEM(&b->orders, at), sizeof(o) * (VEC_LEN(&b->orders) - at - 1));
+	VEC_ITEM(&b->orders, at) = o;
+}
+
+
+// records an order without touching the seller's inventory
+// safe to call concurrently as long as each thread uses its own worker index
+void Market_StageSellOrder(Market* m, int worker, Entity* seller, econid_t item, long qty, money_t price) {
+	if(qty <= 0) return;
+	
+	VEC_PUSH(&m->queues[worker], ((MarketOrder){
+		.seller = seller,
+		.item = item,
+		.qtyAvail = qty,
+		.price = price,
 	}));
 }
 
+
+static int staged_cmp(const void* a, const void* b) {
+	const MarketOrder* x = a;
+	const MarketOrder* y = b;
+	
+	if(x->seller->id != y->seller->id) return x->seller->id < y->seller->id ? -1 : 1;
+	if(x->item != y->item) return x->item < y->item ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+
+static int item_cmp(const void* a, const void* b) {
+	const MarketOrder* x = a;
+	const MarketOrder* y = b;
+	
+	if(x->item != y->item) return x->item < y->item ? -1 : 1;
+	return order_cmp(a, b);
+}
+
+
+// moves every staged order into the books
+// the staged orders are sorted by seller first, so the result is the same
+//   as placing them serially in entity order, whatever the thread count
+void Market_Drain(Market* m) {
+	VEC(MarketOrder) all;
+	VEC_INIT(&all);
+	
+	for(int w = 0; w < m->queueCnt; w++) {
+		VEC_EACHP(&m->queues[w], i, o) {
+			o->seq = i; // keeps a seller's own orders in submission order
+			VEC_PUSH(&all, *o);
+		}
+		VEC_TRUNC(&m->queues[w]);
+	}
+	
+	if(!VEC_LEN(&all)) return;
+	
+	qsort(VEC_DATA(&all), VEC_LEN(&all), sizeof(MarketOrder), staged_cmp);
+	
+	Market_Compact(m);
+	
+	// escrow is taken serially here, in seller order
+	intptr_t n = 0;
+	VEC_EACHP(&all, i, o) {
+		if(o->price < 1) o->price = 1; // HACK
+		
+		long moved = Inv_MoveToEscrow(InvTable_Get(m->invs, o->seller->inv), o->seller->id, o->item, o->qtyAvail);
+		if(moved <= 0) continue;
+		
+		o->qtyAvail = moved;
+		o->seq = m->seq++;
+		schedule_expiry(m, o);
+		VEC_ITEM(&all, n++) = *o;
+	}
+	VEC_LEN(&all) = n;
+	
+	qsort(VEC_DATA(&all), VEC_LEN(&all), sizeof(MarketOrder), item_cmp);
+	
+	// merge each item's run into its book from the back, so nothing moves twice
+	for(intptr_t start = 0; start < n;) {
+		econid_t item = VEC_ITEM(&all, start).item;
+		intptr_t end = start;
+		while(end < n && VEC_ITEM(&all, end).item == item) end++;
+		
+		MarketBook* b = Market_GetBook(m, item);
+		intptr_t i = VEC_LEN(&b->orders) - 1;
+		intptr_t j = end - 1;
+		
+		for(intptr_t k = start; k < end; k++) VEC_INC(&b->orders);
+		
+		for(intptr_t out = VEC_LEN(&b->orders) - 1; j >= start; out--) {
+			if(i >= 0 && order_cmp(&VEC_ITEM(&b->orders, i), &VEC_ITEM(&all, j)) > 0) {
+				VEC_ITEM(&b->orders, out) = VEC_ITEM(&b->orders, i--);
+			}
+			else {
+				VEC_ITEM(&b->orders, out) = VEC_ITEM(&all, j--);
+			}
+		}
+		
+		start = end;
+	}
+	
+	VEC_FREE(&all);
+}
+
+
+static int seller_cmp(const void* a, const void* b) {
+	const MarketOrder* x = a;
+	const MarketOrder* y = b;
+	
+	if(x->seller->id != y->seller->id) return x->seller->id < y->seller->id ? -1 : 1;
+	return x->item < y->item ? -1 : x->item > y->item;
+}
+
+
+// advances the market's clock and takes down the orders expiring now
+// their escrow goes back to the sellers in one pass, ordered by seller
+void Market_Expire(Market* m, tick_t now) {
+	m->now = now;
+	
+	// pull the next revolution's expiries in from the far list
+	if((now & (MARKET_WHEEL_SIZE - 1)) == 0) {
+		for(intptr_t i = 0; i < VEC_LEN(&m->farExpiries); i++) {
+			MarketExpiry* x = &VEC_ITEM(&m->farExpiries, i);
+			if(x->expires - now >= MARKET_WHEEL_SIZE) continue;
+			
+			VEC_PUSH(&m->wheel[x->expires & (MARKET_WHEEL_SIZE - 1)], *x);
+			
+			*x = VEC_TAIL(&m->farExpiries);
+			VEC_LEN(&m->farExpiries)--;
+			i--; // retry this index
+		}
+	}
+	
+	int w = now & (MARKET_WHEEL_SIZE - 1);
+	if(!VEC_LEN(&m->wheel[w])) return;
+	
+	VEC(MarketOrder) expired;
+	VEC_INIT(&expired);
+	
+	VEC_EACHP(&m->wheel[w], i, x) {
+		MarketBook* b = find_book(m, x->item);
+		MarketOrder* o = b ? find_order(b, x->price, x->seq) : NULL;
+		
+		// filled, or the seller is gone
+		if(!o || o->qtyAvail <= 0 || o->seller->dead) continue;
+		
+		VEC_PUSH(&expired, *o);
+		
+		o->qtyAvail = 0;
+		b->emptied++;
+	}
+	
+	VEC_TRUNC(&m->wheel[w]);
+	
+	qsort(VEC_DATA(&expired), VEC_LEN(&expired), sizeof(MarketOrder), seller_cmp);
+	
+	VEC_EACHP(&expired, i, o) {
+		Inv_ReturnEscrow(InvTable_Get(m->invs, o->seller->inv), o->seller->id, o->item, o->qtyAvail);
+	}
+	
+	VEC_FREE(&expired);
+}
+
+
 void Market_BuyNow(Market* m, Entity* buyer, econid_t item, long* qty, money_t* price) {
+	Market_BuyLimit(m, buyer, item, LONG_MAX, qty, price);
+}
+
+
+// buys from the cheapest orders priced at or under maxUnitPrice
+// qty and price are the limits going in, and what was bought and spent coming out
+void Market_BuyLimit(Market* m, Entity* buyer, econid_t item, money_t maxUnitPrice, long* qty, money_t* price) {
 	long maxQ = *qty;
 	money_t maxP = *price;
 	
 	long bought = 0;
 	money_t spent = 0;	
-
 	
-	for(intptr_t i = 0; maxP && maxQ && i < VEC_LEN(&m->sells); i++) {
-		MarketOrder* o = &VEC_ITEM(&m->sells, i);
+	MarketBook* b = find_book(m, item);
+	
+	for(intptr_t i = 0; b && maxP > 0 && maxQ > 0 && i < VEC_LEN(&b->orders); i++) {
+		MarketOrder* o = &VEC_ITEM(&b->orders, i);
 		
-		if(o->item != item) continue;
+		if(o->price > maxUnitPrice) break;
+		if(o->qtyAvail <= 0) continue;
 		
 		// careful of overfow
 		long maxSpend = MIN(o->qtyAvail * o->price, maxP);
@@ -69,25 +390,55 @@ void Market_BuyNow(Market* m, Entity* buyer, econid_t item, long* qty, money_t*
 		
 		if(toBuy == 0) continue;
 		
-		long changed = Inv_EscrowChangeOwner(o->seller->inv, o->seller->id, buyer->id, item, toBuy);
+		long changed = Inv_TakeEscrow(InvTable_Get(m->invs, o->seller->inv), o->seller->id, item, toBuy);
+		
+		if(changed) {
+			VEC_PUSH(&m->fills, ((MarketFill){
+				.seller = o->seller->id,
+				.buyer = buyer->id,
+				.item = item,
+				.qty = changed,
+				.price = changed * o->price,
+			}));
+		}
 		
 		o->qtyAvail -= changed;
+		maxP -= changed * o->price;
 		maxQ -= changed;
 		bought += changed;
 		spent += changed * o->price;
 		
-		// delete empty orders
-		if(o->qtyAvail == 0) {
-			*o = VEC_TAIL(&m->sells);
-			VEC_LEN(&m->sells)--;
-			i--; // retry this index
-		}
+		// filled orders are dropped at the next compaction
+		if(o->qtyAvail == 0) b->emptied++;
 	}
 
 	*qty = bought;
 	*price = spent; 
+}
+
+
+// lowest priced order for the item, 0 if there are none
+// qty gets the amount available at that price
+money_t Market_BestAsk(Market* m, econid_t item, long* qty) {
+	money_t best = 0;
+	long q = 0;
 	
+	MarketBook* b = find_book(m, item);
+	if(!b) {
+		if(qty) *qty = 0;
+		return 0;
+	}
+	
+	VEC_EACHP(&b->orders, i, o) {
+		if(o->qtyAvail <= 0) continue;
+		if(best && o->price != best) break;
+		
+		best = o->price;
+		q += o->qtyAvail;
+	}
 	
+	if(qty) *qty = q;
+	return best;
 }
 
 
@@ -112,13 +463,19 @@ MarketSink* Market_AddSink(Market* m, econid_t item, money_t maxBuyPrice) {
 void Market_RunSinks(Market* m) {
 	
 	VECMP_EACH(&m->sinks, i, sink) {
-		long maxP = sink->maxBuysPerTick * sink->maxBuyPrice;
 		long maxQ = sink->maxBuysPerTick;
+		long maxP = maxQ < 0 ? LONG_MAX : maxQ * sink->maxBuyPrice;
 		if(maxQ < 0) maxQ = LONG_MAX;
 		
+		long q = maxQ;
+		money_t p = maxP;
 		if(maxQ > 0)
-			Market_BuyNow(m, m->sinkEntity, sink->item, &maxQ, &maxP);
+			Market_BuyLimit(m, m->sinkEntity, sink->item, sink->maxBuyPrice, &q, &p);
+		else
+			q = p = 0;
 		
+		sink->leftQty = maxQ - q;
+		sink->leftSpend = maxP - p;
 	}
 
 }
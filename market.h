@@ -7,9 +7,32 @@ typedef struct MarketOrder {
 	long qtyAvail;
 	long minQty;
 	money_t price; // FOB
+	
+	uint64_t seq; // arrival order within the market, never wraps
+	tick_t expires; // 0 for never
 } MarketOrder;
 
 
+// finds an order again through its book's sort key
+typedef struct MarketExpiry {
+	econid_t item;
+	money_t price;
+	uint64_t seq;
+	tick_t expires;
+} MarketExpiry;
+
+// must be a power of two
+#define MARKET_WHEEL_SIZE 256
+
+
+// every order for one item, cheapest first, then oldest
+typedef struct MarketBook {
+	econid_t item;
+	VEC(MarketOrder) orders;
+	long emptied; // filled orders still in the vector
+} MarketBook;
+
+
 // endlessly buys items
 typedef struct MarketSink {
 	econid_t id;
@@ -19,18 +42,56 @@ typedef struct MarketSink {
 	long maxBuysPerTick;
 	money_t maxBuyPrice;
 	econid_t item;
+	
+	// budget left over after the last clearing, for arbitrage
+	long leftQty;
+	money_t leftSpend;
 } MarketSink;
 
 
 
 
-typedef struct Market {
+// a completed purchase; the goods have left the seller's escrow
+typedef struct MarketFill {
+	econid_t seller, buyer;
+	econid_t item;
+	long qty;
+	money_t price; // total
+} MarketFill;
 
-	VEC(MarketOrder) sells;
+
+
+typedef struct Market {
+	econid_t region; // the entity this market serves, 0 for the global market
+	
+	// books by dense item index
+	MarketBook** books;
+	itemidx_t bookAlloc;
+	VEC(MarketBook*) bookList;
+	uint64_t seq; // next order's seq
+	
+	// orders staged by parallel phases, one queue per worker so
+	//   submitting never contends; merged by Market_Drain
+	int queueCnt;
+	VEC(MarketOrder)* queues;
+	
+	tick_t now; // advanced by Market_Expire
+	tick_t orderTTL; // ticks an order stays on the book, 0 for forever
+	
+	// slot i holds orders expiring on ticks t where t % MARKET_WHEEL_SIZE == i,
+	//   for t less than MARKET_WHEEL_SIZE ticks ahead
+	VEC(MarketExpiry) wheel[MARKET_WHEEL_SIZE];
+	VEC(MarketExpiry) farExpiries; // moved in once per revolution
+	
+	// fills since the economy last collected them
+	VEC(MarketFill) fills;
 
 	VECMP(MarketSink) sinks;
 	Entity* sinkEntity;
 	
+	InvTable* invs; // where sellers' inventories live
+	ItemTable* items; // books are kept by dense item index
+	
 } Market;
 
 
@@ -42,8 +103,19 @@ void Market_Destroy(Market* m);
 void Market_Free(Market* m);
 
 
+void Market_RemoveDeadSellers(Market* m);
+
+void Market_SetWorkers(Market* m, int workers);
+MarketBook* Market_GetBook(Market* m, econid_t item);
+
 void Market_AddSellOrder(Market* m, Entity* seller, econid_t item, long qty, money_t price);
+void Market_StageSellOrder(Market* m, int worker, Entity* seller, econid_t item, long qty, money_t price);
+void Market_Drain(Market* m);
+void Market_Compact(Market* m);
+void Market_Expire(Market* m, tick_t now);
 void Market_BuyNow(Market* m, Entity* buyer, econid_t item, long* qty, money_t* price);
+void Market_BuyLimit(Market* m, Entity* buyer, econid_t item, money_t maxUnitPrice, long* qty, money_t* price);
+money_t Market_BestAsk(Market* m, econid_t item, long* qty);
 
 MarketSink* Market_AddSink(Market* m, econid_t item, money_t maxBuyPrice);
 void Market_RunSinks(Market* m);
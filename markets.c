@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+
+#include "econ.h"
+
+
+
+
+// regional markets share the global market's sink entity
+Market* Econ_NewMarket(Economy* ec, econid_t region) {
+	Market* m = Market_New();
+	m->region = region;
+	m->sinkEntity = ec->m ? ec->m->sinkEntity : NULL;
+	m->invs = &ec->invs;
+	m->items = &ec->items;
+	Market_SetWorkers(m, ec->pool.threads);
+	
+	VEC_PUSH(&ec->markets, m);
+	
+	return m;
+}
+
+
+// maps region entities to their markets; call after regions change
+void Econ_BuildMarketIndex(Economy* ec) {
+	free(ec->regionMarkets);
+	ec->regionAlloc = ec->entitySlots;
+	ec->regionMarkets = calloc(1, sizeof(*ec->regionMarkets) * ec->regionAlloc);
+	
+	VEC_EACH(&ec->markets, i, m) {
+		if(!m->region) continue;
+		
+		if(m->region >= ec->regionAlloc) {
+			LOG("Market region %u does not exist", m->region);
+			continue;
+		}
+		
+		ec->regionMarkets[m->region] = m;
+	}
+}
+
+
+// an entity trades in its own market if it is a region, else in its
+//   location's, else in the global market
+Market* Econ_MarketFor(Economy* ec, Entity* e) {
+	if(e->id < ec->regionAlloc && ec->regionMarkets[e->id]) {
+		return ec->regionMarkets[e->id];
+	}
+	
+	if(ec->locationComp >= 0) {
+		econid_t* loc = Entity_Get_id(ec, e, ec->locationComp);
+		if(loc && *loc < ec->regionAlloc && ec->regionMarkets[*loc]) {
+			return ec->regionMarkets[*loc];
+		}
+	}
+	
+	return ec->m;
+}
+
+
+
+
+static void clear_job(void* arg, long i, int worker) {
+	Economy* ec = arg;
+	Market_RunSinks(VEC_ITEM(&ec->markets, i));
+}
+
+
+// every market clears its own book on the worker pool
+// markets touch only their own orders and their sellers' escrow, and
+//   entities sharing an inventory always trade in the same market
+void Econ_ClearMarkets(Economy* ec) {
+	Pool_For(&ec->pool, VEC_LEN(&ec->markets), clear_job, ec);
+}
+
+
+
+
+// freight per unit between two markets; the global market is everywhere
+// returns -1 if there is no route
+static money_t freight(Economy* ec, Market* a, Market* b) {
+	if(!a->region || !b->region || ec->freightRate <= 0) return 0;
+	
+	float d = Econ_TransportCost(ec, a->region, b->region);
+	if(d < 0) return -1;
+	
+	return ceilf(d * ec->freightRate);
+}
+
+
+// sinks with budget left after clearing buy from other markets when the
+//   price plus freight still fits under their limit
+// the budget is spent on the landed cost, ask plus freight, but only the
+//   ask is paid to the seller: there are no carriers to pay yet, so the
+//   freight share of the budget goes unspent rather than to the ledger
+// runs serially after clearing, in market order, so results are repeatable
+void Econ_Arbitrage(Economy* ec) {
+	if(VEC_LEN(&ec->markets) < 2) return;
+	
+	VEC_EACH(&ec->markets, ai, a) {
+		VECMP_EACH(&a->sinks, si, sink) {
+			if(sink->leftQty <= 0 || sink->leftSpend <= 0) continue;
+			
+			VEC_EACH(&ec->markets, bi, b) {
+				if(b == a) continue;
+				
+				money_t f = freight(ec, a, b);
+				if(f < 0) continue;
+				
+				// one price level at a time, so each is budgeted at its own
+				//   landed cost
+				while(sink->leftQty > 0 && sink->leftSpend > 0) {
+					long avail;
+					money_t ask = Market_BestAsk(b, sink->item, &avail);
+					if(!ask || ask + f > sink->maxBuyPrice) break;
+					
+					long q = MIN(MIN(sink->leftQty, avail), sink->leftSpend / (ask + f));
+					if(q <= 0) break;
+					
+					money_t p = q * ask;
+					Market_BuyLimit(b, a->sinkEntity, sink->item, ask, &q, &p);
+					if(q <= 0) break;
+					
+					sink->leftQty -= q;
+					sink->leftSpend -= p + f * q;
+				}
+				
+				if(sink->leftQty <= 0 || sink->leftSpend <= 0) break;
+			}
+		}
+	}
+}
+
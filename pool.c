@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+
+#include "econ.h"
+
+
+
+
+// threads <= 0 picks one per core, or ECON_THREADS from the environment
+// also used to start over in a fork()ed child, which has none of the
+//   parent's threads; the old thread list is abandoned
+void Pool_Init(WorkerPool* p, int threads) {
+	memset(p, 0, sizeof(*p));
+	
+	if(threads <= 0) {
+		char* env = getenv("ECON_THREADS");
+		threads = env ? atoi(env) : sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	
+	p->threads = MAX(1, threads);
+	
+	pthread_mutex_init(&p->mtx, NULL);
+	pthread_cond_init(&p->wake, NULL);
+	pthread_cond_init(&p->done, NULL);
+}
+
+
+static void run_items(WorkerPool* p, int worker) {
+	while(1) {
+		long i = atomic_fetch_add(&p->next, 1);
+		if(i >= p->count) break;
+		
+		p->fn(p->arg, i, worker);
+	}
+}
+
+
+static void* worker_main(void* arg) {
+	WorkerPool* p = arg;
+	
+	pthread_mutex_lock(&p->mtx);
+	int worker = ++p->started;
+	uint64_t seen = p->gen;
+	
+	while(1) {
+		while(!p->quit && p->gen == seen) {
+			pthread_cond_wait(&p->wake, &p->mtx);
+		}
+		if(p->quit) break;
+		
+		seen = p->gen;
+		pthread_mutex_unlock(&p->mtx);
+		
+		run_items(p, worker);
+		
+		pthread_mutex_lock(&p->mtx);
+		if(--p->busy == 0) pthread_cond_signal(&p->done);
+	}
+	
+	pthread_mutex_unlock(&p->mtx);
+	return NULL;
+}
+
+
+// threads are only started on first use, so a pool that is never needed costs nothing
+static void start_threads(WorkerPool* p) {
+	p->tids = calloc(1, sizeof(*p->tids) * p->threads);
+	
+	for(int i = 1; i < p->threads; i++) {
+		pthread_create(&p->tids[i], NULL, worker_main, p);
+	}
+	
+	// wait for them all to be listening
+	pthread_mutex_lock(&p->mtx);
+	while(p->started < p->threads - 1) {
+		pthread_mutex_unlock(&p->mtx);
+		sched_yield();
+		pthread_mutex_lock(&p->mtx);
+	}
+	pthread_mutex_unlock(&p->mtx);
+}
+
+
+void Pool_Destroy(WorkerPool* p) {
+	if(p->tids) {
+		pthread_mutex_lock(&p->mtx);
+		p->quit = 1;
+		pthread_cond_broadcast(&p->wake);
+		pthread_mutex_unlock(&p->mtx);
+		
+		for(int i = 1; i < p->threads; i++) {
+			pthread_join(p->tids[i], NULL);
+		}
+		free(p->tids);
+		p->tids = NULL;
+	}
+	
+	pthread_mutex_destroy(&p->mtx);
+	pthread_cond_destroy(&p->wake);
+	pthread_cond_destroy(&p->done);
+}
+
+
+// runs fn for every i in [0, count) and returns when all are done
+// items are claimed dynamically, so the order across workers is not fixed
+void Pool_For(WorkerPool* p, long count, PoolFn fn, void* arg) {
+	if(count <= 0) return;
+	
+	if(p->threads == 1 || count == 1) {
+		for(long i = 0; i < count; i++) fn(arg, i, 0);
+		return;
+	}
+	
+	if(!p->tids) start_threads(p);
+	
+	pthread_mutex_lock(&p->mtx);
+	p->fn = fn;
+	p->arg = arg;
+	p->count = count;
+	atomic_store(&p->next, 0);
+	p->busy = p->threads - 1;
+	p->gen++;
+	pthread_cond_broadcast(&p->wake);
+	pthread_mutex_unlock(&p->mtx);
+	
+	run_items(p, 0);
+	
+	pthread_mutex_lock(&p->mtx);
+	while(p->busy > 0) {
+		pthread_cond_wait(&p->done, &p->mtx);
+	}
+	pthread_mutex_unlock(&p->mtx);
+}
+
@@ -0,0 +1,37 @@
+
+
+// a fixed set of worker threads for data parallel phases
+//   the calling thread takes part as worker 0, so a pool of one runs inline
+
+
+
+// i is the work item, worker is in [0, threads)
+typedef void (*PoolFn)(void* arg, long i, int worker);
+
+typedef struct WorkerPool {
+	int threads; // including the caller
+	int started;
+	pthread_t* tids;
+	
+	pthread_mutex_t mtx;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	
+	// the current job
+	uint64_t gen;
+	PoolFn fn;
+	void* arg;
+	long count;
+	atomic_long next;
+	int busy; // workers still running the job
+	
+	int quit;
+} WorkerPool;
+
+
+
+
+void Pool_Init(WorkerPool* p, int threads);
+void Pool_Destroy(WorkerPool* p);
+void Pool_For(WorkerPool* p, long count, PoolFn fn, void* arg);
+
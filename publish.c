@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+
+#include "econ.h"
+
+
+
+
+// sizes the region for the world as it is now, with room to grow
+// entType may be NULL; cols are query column names, see query.h
+Publisher* Econ_OpenPublisher(Economy* ec, char* name, uint32_t every, char* entType, char** cols, int colCnt) {
+	if(!name) {
+		LOG("Publisher: no shared memory name given");
+		return NULL;
+	}
+	
+	colCnt = MIN(colCnt, PUB_MAXCOLS);
+	
+	uint32_t items = ec->items.count;
+	
+	int rowType = entType ? Economy_EntityType(ec, entType) : -1;
+	EntityDef* rowDef = rowType >= 0 ? Economy_GetEntityDef(ec, rowType) : NULL;
+	if(entType && !rowDef) {
+		LOG("Publisher: unknown entity type '%s'", entType);
+	}
+	
+	uint32_t itemCap = items * 2 + 64;
+	uint32_t bookCap = itemCap * VEC_LEN(&ec->markets);
+	uint32_t rowCap = rowDef ? VEC_LEN(&rowDef->instances) * 2 + 64 : 0;
+	if(!rowDef) colCnt = 0;
+	
+	size_t size = sizeof(PubHeader);
+	size_t itemsOff = size;
+	size += sizeof(PubItem) * itemCap;
+	size_t booksOff = size;
+	size += sizeof(PubBookTop) * bookCap;
+	size_t rowIdsOff = size;
+	size += (sizeof(uint32_t) * rowCap + 7) & ~7;
+	size_t rowsOff = size;
+	size += sizeof(double) * rowCap * colCnt;
+	
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if(fd < 0) {
+		LOG("Publisher: could not open shared memory '%s'", name);
+		return NULL;
+	}
+	
+	PubHeader* h = MAP_FAILED;
+	if(!ftruncate(fd, size)) {
+		h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	if(h == MAP_FAILED) {
+		LOG("Publisher: could not map %zu bytes of '%s'", size, name);
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	
+	// readers that map it before the first publication see an odd sequence
+	memset(h, 0, size);
+	atomic_store(&h->seq, 1);
+	
+	h->magic = PUB_MAGIC;
+	h->version = PUB_VERSION;
+	h->size = size;
+	h->itemCap = itemCap;
+	h->bookCap = bookCap;
+	h->rowCap = rowCap;
+	h->colCnt = colCnt;
+	h->itemsOff = itemsOff;
+	h->booksOff = booksOff;
+	h->rowIdsOff = rowIdsOff;
+	h->rowsOff = rowsOff;
+	
+	Publisher* pub = calloc(1, sizeof(*pub));
+	pub->name = strdup(name);
+	pub->fd = fd;
+	pub->h = h;
+	pub->every = MAX(1, every);
+	pub->entType = rowDef ? rowType : -1;
+	
+	// unknown columns are logged by the resolver and publish as 0
+	pub->cols = calloc(1, sizeof(*pub->cols) * PUB_MAXCOLS);
+	for(int i = 0; i < colCnt; i++) {
+		strncpy(h->colNames[i], cols[i], PUB_NAMELEN - 1);
+		Query_ResolveColumn(ec, cols[i], &pub->cols[i]);
+	}
+	
+	return pub;
+}
+
+
+// removes the region; readers that still have it mapped keep their copy
+void Publisher_Close(Publisher* pub) {
+	if(!pub) return;
+	
+	munmap(pub->h, pub->h->size);
+	close(pub->fd);
+	shm_unlink(pub->name);
+	
+	free(pub->cols);
+	free(pub->name);
+	free(pub);
+}
+
+
+
+// rewrites the whole region under the seqlock
+// the tick pays for one pass over the items, books and published rows
+void Econ_Publish(Economy* ec, Publisher* pub) {
+	PubHeader* h = pub->h;
+	uint32_t flags = 0;
+	
+	uint64_t s = atomic_load_explicit(&h->seq, memory_order_relaxed);
+	if(!(s & 1)) {
+		atomic_store_explicit(&h->seq, s + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+	}
+	
+	uint32_t n = 0;
+	PubItem* items = Pub_Items(h);
+	VEC_EACH(&ec->totals.items, i, item) {
+		if(n >= h->itemCap) {
+			flags |= PUBF_TRUNCATED;
+			break;
+		}
+		
+		PubItem* pi = &items[n++];
+		pi->item = item;
+		for(int b = 0; b < TOT_MAXVALUE; b++) {
+			pi->totals[b] = Totals_Get(&ec->totals, item, b);
+		}
+		
+		ItemTradeStats* ts = Trades_Stats(&ec->trades, item);
+		pi->last = ts ? ts->last : 0;
+		pi->vwap = Trades_VWAP(&ec->trades, item, 0);
+		pi->volume = ts ? ts->volume : 0;
+	}
+	h->itemCnt = n;
+	
+	n = 0;
+	PubBookTop* books = Pub_Books(h);
+	VEC_EACH(&ec->markets, mi, m) {
+		VEC_EACH(&m->bookList, bi, b) {
+			if(n >= h->bookCap) {
+				flags |= PUBF_TRUNCATED;
+				break;
+			}
+			
+			PubBookTop* pb = &books[n++];
+			pb->region = m->region;
+			pb->item = b->item;
+			pb->bestAsk = Market_BestAsk(m, b->item, &pb->askQty);
+			pb->orders = VEC_LEN(&b->orders) - b->emptied;
+		}
+	}
+	h->bookCnt = n;
+	
+	n = 0;
+	if(pub->entType >= 0) {
+		EntityDef* ed = Economy_GetEntityDef(ec, pub->entType);
+		uint32_t* ids = Pub_RowIds(h);
+		
+		VEC_EACH(&ed->instances, i, eid) {
+			Entity* e = Econ_GetEntity(ec, eid);
+			if(e->dead) continue;
+			
+			if(n >= h->rowCap) {
+				flags |= PUBF_TRUNCATED;
+				break;
+			}
+			
+			ids[n] = eid;
+			double* row = Pub_Row(h, n);
+			for(uint32_t c = 0; c < h->colCnt; c++) {
+				row[c] = Query_ColumnValue(ec, e, &pub->cols[c]);
+			}
+			n++;
+		}
+	}
+	h->rowCnt = n;
+	
+	h->tick = ec->tick;
+	h->flags = flags;
+	
+	atomic_store_explicit(&h->seq, (s | 1) + 1, memory_order_release);
+}
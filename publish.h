@@ -0,0 +1,128 @@
+#ifndef __econsim_publish_h__
+#define __econsim_publish_h__
+
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+
+// live world state in a POSIX shared memory region, for local observers
+//   the sim rewrites the region in place every few ticks under a seqlock;
+//   readers map it read-only and check the sequence around what they read,
+//   so they never block the tick and the tick never waits on them
+// readers only need this header, not the rest of the economy
+
+
+
+#define PUB_MAGIC 0x42555043 // "CPUB"
+#define PUB_VERSION 1
+
+#define PUB_MAXCOLS 8
+#define PUB_NAMELEN 32
+
+// set when something did not fit in the region's fixed capacities
+#define PUBF_TRUNCATED 0x1
+
+
+typedef struct PubItem {
+	uint32_t item;
+	uint32_t _pad;
+	int64_t totals[6]; // indexed by TOT_* bucket
+	int64_t last, vwap, volume;
+} PubItem;
+
+
+// the top of one market's book for one item
+typedef struct PubBookTop {
+	uint32_t region; // 0 for the global market
+	uint32_t item;
+	int64_t bestAsk; // unit price, 0 if nothing is offered
+	int64_t askQty; // available at bestAsk
+	int64_t orders;
+} PubBookTop;
+
+
+typedef struct PubHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size; // of the whole region
+	
+	// odd while the sim is writing
+	_Atomic uint64_t seq;
+	
+	uint32_t tick;
+	uint32_t flags;
+	
+	uint32_t itemCnt, itemCap;
+	uint32_t bookCnt, bookCap;
+	uint32_t rowCnt, rowCap;
+	uint32_t colCnt;
+	uint32_t _pad;
+	
+	char colNames[PUB_MAXCOLS][PUB_NAMELEN];
+	
+	// byte offsets from the start of the region
+	uint64_t itemsOff; // PubItem[itemCap]
+	uint64_t booksOff; // PubBookTop[bookCap]
+	uint64_t rowIdsOff; // uint32_t[rowCap], entity ids
+	uint64_t rowsOff; // double[rowCap][colCnt]
+} PubHeader;
+
+
+
+
+static inline PubItem* Pub_Items(PubHeader* h) {
+	return (PubItem*)((char*)h + h->itemsOff);
+}
+
+static inline PubBookTop* Pub_Books(PubHeader* h) {
+	return (PubBookTop*)((char*)h + h->booksOff);
+}
+
+static inline uint32_t* Pub_RowIds(PubHeader* h) {
+	return (uint32_t*)((char*)h + h->rowIdsOff);
+}
+
+static inline double* Pub_Row(PubHeader* h, uint32_t row) {
+	return (double*)((char*)h + h->rowsOff) + (uint64_t)row * h->colCnt;
+}
+
+
+// reader side: read between Pub_ReadBegin and Pub_ReadRetry, and start
+//   over whenever Pub_ReadRetry returns nonzero
+static inline uint64_t Pub_ReadBegin(PubHeader* h) {
+	uint64_t s;
+	while((s = atomic_load_explicit(&h->seq, memory_order_acquire)) & 1);
+	return s;
+}
+
+static inline int Pub_ReadRetry(PubHeader* h, uint64_t s) {
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&h->seq, memory_order_relaxed) != s;
+}
+
+
+
+
+// writer side, owned by the economy
+
+typedef struct Publisher {
+	char* name;
+	int fd;
+	PubHeader* h;
+	
+	uint32_t every; // ticks between publications
+	
+	int entType; // entity type whose rows are published, -1 for none
+	struct QueryCol* cols; // h->colCnt resolved query columns
+} Publisher;
+
+
+struct Economy;
+Publisher* Econ_OpenPublisher(struct Economy* ec, char* name, uint32_t every, char* entType, char** cols, int colCnt);
+void Publisher_Close(Publisher* pub);
+void Econ_Publish(struct Economy* ec, Publisher* pub);
+
+
+
+#endif // __econsim_publish_h__
@@ -0,0 +1,469 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "econ.h"
+
+
+
+
+// every type when entType is NULL
+void Query_Init(Query* q, Economy* ec, char* entType) {
+	memset(q, 0, sizeof(*q));
+	VEC_INIT(&q->types);
+	VEC_INIT(&q->filters);
+	VEC_INIT(&q->cols);
+	VEC_INIT(&q->aggs);
+	q->orderCol = -1;
+	
+	if(!entType) {
+		VECMP_EACH(&ec->entityDefs, i, ed) {
+			VEC_PUSH(&q->types, ed->id);
+		}
+		return;
+	}
+	
+	int t = Economy_EntityType(ec, entType);
+	if(t < 0) {
+		LOG("Query: unknown entity type '%s'", entType);
+		q->bad = 1;
+		return;
+	}
+	
+	VEC_PUSH(&q->types, t);
+}
+
+
+void Query_Destroy(Query* q) {
+	VEC_FREE(&q->types);
+	VEC_FREE(&q->filters);
+	VEC_FREE(&q->cols);
+	VEC_FREE(&q->aggs);
+}
+
+
+
+// returns 0 on success
+int Query_ResolveColumn(Economy* ec, char* name, QueryCol* out) {
+	static char* buckets[] = {
+		[TOT_INV] = "inv",
+		[TOT_ESCROW] = "escrow",
+		[TOT_TRANSIT] = "transit",
+		[TOT_CONSUMED] = "consumed",
+		[TOT_CREATED] = "created",
+		[TOT_DESTROYED] = "destroyed",
+	};
+	
+	static char* stats[] = {
+		[QTRADE_LAST] = "last",
+		[QTRADE_VWAP] = "vwap",
+		[QTRADE_VOLUME] = "volume",
+		[QTRADE_OPEN] = "open",
+		[QTRADE_HIGH] = "high",
+		[QTRADE_LOW] = "low",
+		[QTRADE_CLOSE] = "close",
+	};
+	
+	out->kind = QCOL_NONE;
+	out->id = 0;
+	
+	if(name[0] == '!') {
+		out->id = Econ_FindItem(ec, name + 1);
+		if(out->id) out->kind = QCOL_ITEM;
+	}
+	else if(name[0] == '#') {
+		for(int b = 0; b < TOT_MAXVALUE; b++) {
+			if(strcmp(name + 1, buckets[b])) continue;
+			out->kind = QCOL_TOTAL;
+			out->id = b;
+		}
+	}
+	else if(name[0] == '$') {
+		for(int s = 0; s < QTRADE_MAXVALUE; s++) {
+			if(strcmp(name + 1, stats[s])) continue;
+			out->kind = QCOL_TRADE;
+			out->id = s;
+		}
+	}
+	else {
+		char buf[128];
+		strncpy(buf, name, sizeof(buf) - 1);
+		buf[sizeof(buf) - 1] = 0;
+		
+		char* dot = strchr(buf, '.');
+		if(dot) *dot = 0;
+		
+		int ctype = Econ_CompTypeFromName(ec, buf);
+		CompDef* cd = ctype >= 0 ? Econ_GetCompDef(ec, ctype) : NULL;
+		
+		if(cd && dot && !strcmp(dot + 1, "item") && (cd->type == CT_itemRate || cd->type == CT_itemPrice)) {
+			out->kind = QCOL_COMPITEM;
+			out->id = ctype;
+		}
+		else if(cd && !dot) {
+			out->kind = QCOL_COMP;
+			out->id = ctype;
+		}
+	}
+	
+	if(out->kind == QCOL_NONE) {
+		LOG("Query: unknown column '%s'", name);
+		return 1;
+	}
+	
+	return 0;
+}
+
+
+// 0 for anything missing or not numeric
+double Query_ColumnValue(Economy* ec, Entity* e, QueryCol* col) {
+	switch(col->kind) {
+		case QCOL_NONE:
+			return 0;
+		
+		case QCOL_ITEM: {
+			InvItem* it = Inv_GetItemP(Entity_Inv(ec, e), col->id);
+			return it ? it->count : 0;
+		}
+		
+		case QCOL_TOTAL:
+			return Totals_Get(&ec->totals, e->id, col->id);
+		
+		case QCOL_TRADE: {
+			ItemTradeStats* s = Trades_Stats(&ec->trades, e->id);
+			TradeBar* b = Trades_Bar(&ec->trades, e->id, 0);
+			if(!s) return 0;
+			
+			switch(col->id) {
+				case QTRADE_LAST: return s->last;
+				case QTRADE_VWAP: return Trades_VWAP(&ec->trades, e->id, 0);
+				case QTRADE_VOLUME: return s->volume;
+				case QTRADE_OPEN: return b ? b->open : 0;
+				case QTRADE_HIGH: return b ? b->high : 0;
+				case QTRADE_LOW: return b ? b->low : 0;
+				case QTRADE_CLOSE: return b ? b->close : 0;
+			}
+			return 0;
+		}
+		
+		case QCOL_COMP:
+		case QCOL_COMPITEM:
+			break;
+	}
+	
+	Comp* c = Entity_GetComp(e, col->id);
+	if(!c) return 0;
+	
+	// arrays read their first element
+	int n;
+	void* p = Comp_Data(ec, c, &n);
+	if(!n) return 0;
+	
+	switch(Econ_GetCompDef(ec, c->type)->type) {
+		case CT_int: return *(int64_t*)p;
+		case CT_float: return *(double*)p;
+		case CT_id: return *(econid_t*)p;
+		case CT_itemRate: return col->kind == QCOL_COMPITEM ? ((ItemRate*)p)->item : ((ItemRate*)p)->rate;
+		case CT_itemPrice: return col->kind == QCOL_COMPITEM ? ((ItemPrice*)p)->item : ((ItemPrice*)p)->price;
+		default: return 0;
+	}
+}
+
+
+static int has_column(Economy* ec, Entity* e, QueryCol* col) {
+	switch(col->kind) {
+		case QCOL_COMP:
+		case QCOL_COMPITEM:
+			return Entity_GetComp(e, col->id) != NULL;
+		
+		default:
+			return Query_ColumnValue(ec, e, col) != 0;
+	}
+}
+
+
+
+// the builders return nonzero if the column is unknown, which also makes
+//   the whole query match nothing
+
+int Query_Where(Query* q, Economy* ec, char* col, enum QueryOp op, double value) {
+	QueryCol qc;
+	if(Query_ResolveColumn(ec, col, &qc)) return q->bad = 1;
+	
+	VEC_PUSH(&q->filters, ((struct QueryFilter){qc, op, value}));
+	return 0;
+}
+
+
+// returns the column's index in the result rows, or -1
+int Query_Select(Query* q, Economy* ec, char* col) {
+	QueryCol qc;
+	if(Query_ResolveColumn(ec, col, &qc)) {
+		q->bad = 1;
+		return -1;
+	}
+	
+	VEC_PUSH(&q->cols, qc);
+	return VEC_LEN(&q->cols) - 1;
+}
+
+
+// col is ignored for QAGG_COUNT and may be NULL
+// returns the aggregate's index in the result, or -1
+int Query_Aggregate(Query* q, Economy* ec, char* col, enum QueryAgg agg) {
+	QueryCol qc = {QCOL_NONE, 0};
+	if(agg != QAGG_COUNT && Query_ResolveColumn(ec, col, &qc)) {
+		q->bad = 1;
+		return -1;
+	}
+	
+	VEC_PUSH(&q->aggs, ((struct QueryAggDef){qc, agg}));
+	return VEC_LEN(&q->aggs) - 1;
+}
+
+
+// col is an index returned by Query_Select; -1 keeps scan order
+void Query_OrderBy(Query* q, int col, int desc, long limit) {
+	q->orderCol = col;
+	q->desc = desc;
+	q->limit = MAX(0, limit);
+}
+
+
+
+
+void QueryResult_Init(QueryResult* r) {
+	memset(r, 0, sizeof(*r));
+	VEC_INIT(&r->ids);
+	VEC_INIT(&r->values);
+	VEC_INIT(&r->aggs);
+}
+
+void QueryResult_Destroy(QueryResult* r) {
+	VEC_FREE(&r->ids);
+	VEC_FREE(&r->values);
+	VEC_FREE(&r->aggs);
+}
+
+
+
+
+#define QUERY_CHUNK 4096
+
+// partial aggregate
+struct agg_acc {
+	long n;
+	double sum, min, max;
+};
+
+// rows are stored as [sort key, id, values...] so they can be sorted whole
+struct chunk_out {
+	int type;
+	long start, end;
+	
+	long matched;
+	VEC(double) rows;
+	struct agg_acc* accs;
+};
+
+struct query_run {
+	Economy* ec;
+	Query* q;
+	int stride;
+	struct chunk_out* chunks;
+};
+
+
+static int row_cmp(const void* a, const void* b) {
+	const double* x = a;
+	const double* y = b;
+	
+	if(x[0] != y[0]) return x[0] < y[0] ? -1 : 1;
+	return x[1] < y[1] ? -1 : x[1] > y[1];
+}
+
+
+static int passes(Economy* ec, Query* q, Entity* e) {
+	VEC_EACHP(&q->filters, i, f) {
+		if(f->op == QOP_HAS) {
+			if(!has_column(ec, e, &f->col)) return 0;
+			continue;
+		}
+		
+		double v = Query_ColumnValue(ec, e, &f->col);
+		int ok = 0;
+		switch(f->op) {
+			case QOP_EQ: ok = v == f->value; break;
+			case QOP_NE: ok = v != f->value; break;
+			case QOP_LT: ok = v < f->value; break;
+			case QOP_LE: ok = v <= f->value; break;
+			case QOP_GT: ok = v > f->value; break;
+			case QOP_GE: ok = v >= f->value; break;
+			case QOP_HAS: break;
+		}
+		if(!ok) return 0;
+	}
+	
+	return 1;
+}
+
+
+static void run_chunk(void* arg, long ci, int worker) {
+	struct query_run* run = arg;
+	Economy* ec = run->ec;
+	Query* q = run->q;
+	struct chunk_out* co = &run->chunks[ci];
+	
+	EntityDef* ed = Economy_GetEntityDef(ec, co->type);
+	int colCnt = VEC_LEN(&q->cols);
+	
+	for(long i = co->start; i < co->end; i++) {
+		Entity* e = Econ_GetEntity(ec, VEC_ITEM(&ed->instances, i));
+		if(e->dead || !passes(ec, q, e)) continue;
+		
+		co->matched++;
+		
+		for(int a = 0; a < VEC_LEN(&q->aggs); a++) {
+			struct agg_acc* acc = &co->accs[a];
+			double v = Query_ColumnValue(ec, e, &VEC_ITEM(&q->aggs, a).col);
+			
+			acc->min = acc->n ? MIN(acc->min, v) : v;
+			acc->max = acc->n ? MAX(acc->max, v) : v;
+			acc->sum += v;
+			acc->n++;
+		}
+		
+		if(!colCnt) continue;
+		
+		for(int k = 0; k < run->stride; k++) VEC_PUSH(&co->rows, 0);
+		double* row = &VEC_ITEM(&co->rows, VEC_LEN(&co->rows) - run->stride);
+		
+		row[1] = e->id;
+		for(int c = 0; c < colCnt; c++) {
+			row[2 + c] = Query_ColumnValue(ec, e, &VEC_ITEM(&q->cols, c));
+		}
+		if(q->orderCol >= 0) row[0] = q->desc ? -row[2 + q->orderCol] : row[2 + q->orderCol];
+	}
+	
+	// only this chunk's best rows can make the final cut
+	long n = VEC_LEN(&co->rows) / run->stride;
+	if(q->limit && n > q->limit) {
+		if(q->orderCol >= 0) {
+			qsort(VEC_DATA(&co->rows), n, sizeof(double) * run->stride, row_cmp);
+		}
+		VEC_LEN(&co->rows) = q->limit * run->stride;
+	}
+}
+
+
+// replaces whatever r held
+void Query_Run(Economy* ec, Query* q, QueryResult* r) {
+	int colCnt = VEC_LEN(&q->cols);
+	int aggCnt = VEC_LEN(&q->aggs);
+	
+	r->matched = 0;
+	r->rowCnt = 0;
+	r->colCnt = colCnt;
+	VEC_TRUNC(&r->ids);
+	VEC_TRUNC(&r->values);
+	VEC_TRUNC(&r->aggs);
+	
+	for(int a = 0; a < aggCnt; a++) VEC_PUSH(&r->aggs, 0);
+	if(q->bad) return;
+	
+	// the plan: fixed slices of each type's instance list
+	VEC(struct chunk_out) chunks;
+	VEC_INIT(&chunks);
+	
+	VEC_EACH(&q->types, ti, type) {
+		EntityDef* ed = Economy_GetEntityDef(ec, type);
+		long cnt = VEC_LEN(&ed->instances);
+		
+		for(long s = 0; s < cnt; s += QUERY_CHUNK) {
+			struct chunk_out co = {
+				.type = type,
+				.start = s,
+				.end = MIN(cnt, s + QUERY_CHUNK),
+				.accs = calloc(1, sizeof(struct agg_acc) * (aggCnt + 1)),
+			};
+			VEC_INIT(&co.rows);
+			VEC_PUSH(&chunks, co);
+		}
+	}
+	
+	struct query_run run = {
+		.ec = ec,
+		.q = q,
+		.stride = 2 + colCnt,
+		.chunks = VEC_DATA(&chunks),
+	};
+	
+	if(q->parallel) {
+		Pool_For(&ec->pool, VEC_LEN(&chunks), run_chunk, &run);
+	}
+	else {
+		for(long i = 0; i < VEC_LEN(&chunks); i++) run_chunk(&run, i, 0);
+	}
+	
+	// merged in chunk order, so the result doesn't depend on the thread count
+	VEC(double) rows;
+	VEC_INIT(&rows);
+	
+	struct agg_acc* accs = calloc(1, sizeof(*accs) * (aggCnt + 1));
+	
+	VEC_EACHP(&chunks, ci, co) {
+		r->matched += co->matched;
+		
+		for(long k = 0; k < VEC_LEN(&co->rows); k++) {
+			VEC_PUSH(&rows, VEC_ITEM(&co->rows, k));
+		}
+		
+		for(int a = 0; a < aggCnt; a++) {
+			struct agg_acc* x = &co->accs[a];
+			if(!x->n) continue;
+			
+			accs[a].min = accs[a].n ? MIN(accs[a].min, x->min) : x->min;
+			accs[a].max = accs[a].n ? MAX(accs[a].max, x->max) : x->max;
+			accs[a].sum += x->sum;
+			accs[a].n += x->n;
+		}
+		
+		VEC_FREE(&co->rows);
+		free(co->accs);
+	}
+	
+	for(int a = 0; a < aggCnt; a++) {
+		struct agg_acc* x = &accs[a];
+		double v = 0;
+		
+		switch(VEC_ITEM(&q->aggs, a).agg) {
+			case QAGG_COUNT: v = x->n; break;
+			case QAGG_SUM: v = x->sum; break;
+			case QAGG_MIN: v = x->min; break;
+			case QAGG_MAX: v = x->max; break;
+			case QAGG_AVG: v = x->n ? x->sum / x->n : 0; break;
+		}
+		
+		VEC_ITEM(&r->aggs, a) = v;
+	}
+	
+	long n = colCnt ? VEC_LEN(&rows) / run.stride : 0;
+	if(n && q->orderCol >= 0) {
+		qsort(VEC_DATA(&rows), n, sizeof(double) * run.stride, row_cmp);
+	}
+	if(q->limit) n = MIN(n, q->limit);
+	
+	for(long i = 0; i < n; i++) {
+		double* row = &VEC_ITEM(&rows, i * run.stride);
+		
+		VEC_PUSH(&r->ids, (econid_t)row[1]);
+		for(int c = 0; c < colCnt; c++) {
+			VEC_PUSH(&r->values, row[2 + c]);
+		}
+	}
+	r->rowCnt = n;
+	
+	free(accs);
+	VEC_FREE(&rows);
+	VEC_FREE(&chunks);
+}
@@ -0,0 +1,119 @@
+
+
+
+// filter / project / aggregate / top-k scans over entity columns
+//   a query is built once, resolving every column name up front, and can
+//   then be run any number of times; each run walks only the instance lists
+//   of the entity types it targets, in chunks, optionally on the worker pool
+// column names, shared with the ui views:
+//   "cash"          a numeric component; itemRate and itemPrice give the rate or price
+//   "sells.item"    the item of an itemRate or itemPrice component
+//   array components read as their first element
+//   "!Log"          inventory count of an item
+//   "#inv"          world total of the row's own item, by totals bucket
+//   "$vwap"         trading statistic of the row's own item
+
+
+
+enum QueryColKind {
+	QCOL_NONE = 0,
+	QCOL_COMP,
+	QCOL_COMPITEM,
+	QCOL_ITEM,
+	QCOL_TOTAL,
+	QCOL_TRADE,
+};
+
+enum QueryTradeStat {
+	QTRADE_LAST = 0,
+	QTRADE_VWAP, // over the whole run
+	QTRADE_VOLUME,
+	QTRADE_OPEN, // the newest bar
+	QTRADE_HIGH,
+	QTRADE_LOW,
+	QTRADE_CLOSE,
+	
+	QTRADE_MAXVALUE,
+};
+
+typedef struct QueryCol {
+	enum QueryColKind kind;
+	int id; // component type, item entity, totals bucket, or trade stat
+} QueryCol;
+
+
+enum QueryOp {
+	QOP_EQ,
+	QOP_NE,
+	QOP_LT,
+	QOP_LE,
+	QOP_GT,
+	QOP_GE,
+	QOP_HAS, // the component is present, or the item is held
+};
+
+enum QueryAgg {
+	QAGG_COUNT,
+	QAGG_SUM,
+	QAGG_MIN,
+	QAGG_MAX,
+	QAGG_AVG,
+};
+
+
+typedef struct Query {
+	VEC(int) types; // entity defs to scan
+	
+	VEC(struct QueryFilter {
+		QueryCol col;
+		enum QueryOp op;
+		double value;
+	}) filters;
+	
+	VEC(QueryCol) cols; // projected, in result order
+	
+	VEC(struct QueryAggDef {
+		QueryCol col;
+		enum QueryAgg agg;
+	}) aggs;
+	
+	// top-k: rows sorted on a projected column, cut to limit
+	int orderCol; // -1 keeps scan order
+	int desc;
+	long limit; // 0 for every row
+	
+	int parallel;
+	int bad; // a column failed to resolve; the query matches nothing
+} Query;
+
+
+typedef struct QueryResult {
+	long matched; // rows passing the filters, before the limit
+	long rowCnt;
+	int colCnt;
+	VEC(econid_t) ids;
+	VEC(double) values; // rowCnt rows of colCnt
+	VEC(double) aggs; // one per Query_Aggregate, in call order
+} QueryResult;
+
+
+
+
+void Query_Init(Query* q, struct Economy* ec, char* entType);
+void Query_Destroy(Query* q);
+
+int Query_ResolveColumn(struct Economy* ec, char* name, QueryCol* out);
+double Query_ColumnValue(struct Economy* ec, Entity* e, QueryCol* col);
+
+int Query_Where(Query* q, struct Economy* ec, char* col, enum QueryOp op, double value);
+int Query_Select(Query* q, struct Economy* ec, char* col);
+int Query_Aggregate(Query* q, struct Economy* ec, char* col, enum QueryAgg agg);
+void Query_OrderBy(Query* q, int col, int desc, long limit);
+
+void QueryResult_Init(QueryResult* r);
+void QueryResult_Destroy(QueryResult* r);
+void Query_Run(struct Economy* ec, Query* q, QueryResult* r);
+
+static inline double* QueryResult_Row(QueryResult* r, long row) {
+	return &VEC_ITEM(&r->values, row * r->colCnt);
+}
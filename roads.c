@@ -0,0 +1,502 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+
+#include "econ.h"
+
+
+
+
+void Roads_Init(RoadGraph* rg) {
+	memset(rg, 0, sizeof(*rg));
+
+	VEC_INIT(&rg->nodes);
+	VEC_INIT(&rg->edges);
+	VEC_INIT(&rg->heap);
+
+	rg->lookupAlloc = 1024;
+	rg->lookup = calloc(1, sizeof(*rg->lookup) * rg->lookupAlloc);
+}
+
+
+void Roads_Destroy(RoadGraph* rg) {
+	for(int i = 0; i < rg->treeCnt; i++) {
+		free(rg->trees[i].dist);
+		free(rg->trees[i].pred);
+	}
+
+	free(rg->lookup);
+	free(rg->rowStart);
+	free(rg->adj);
+
+	VEC_FREE(&rg->nodes);
+	VEC_FREE(&rg->edges);
+	VEC_FREE(&rg->heap);
+}
+
+
+// drops every node and edge; cached trees are recycled on their next use
+void Roads_Clear(RoadGraph* rg) {
+	VEC_TRUNC(&rg->nodes);
+	VEC_TRUNC(&rg->edges);
+	memset(rg->lookup, 0, sizeof(*rg->lookup) * rg->lookupAlloc);
+
+	free(rg->rowStart);
+	free(rg->adj);
+	rg->rowStart = NULL;
+	rg->adj = NULL;
+	rg->csrNodes = 0;
+	rg->csrEdges = 0;
+
+	rg->epoch++;
+}
+
+
+
+
+static uint32_t point_hash(EcPoint p) {
+	union { float f; uint32_t u; } x = {p.x + 0.0f}, y = {p.y + 0.0f}; // folds -0 into 0
+	uint64_t k = ((uint64_t)x.u << 32) | y.u;
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdull;
+	k ^= k >> 33;
+	return k;
+}
+
+
+static uint32_t* lookup_slot(RoadGraph* rg, EcPoint p) {
+	uint32_t mask = rg->lookupAlloc - 1;
+
+	for(uint32_t i = point_hash(p) & mask; ; i = (i + 1) & mask) {
+		uint32_t n = rg->lookup[i];
+		if(!n) return &rg->lookup[i];
+
+		EcPoint* q = &VEC_ITEM(&rg->nodes, n - 1);
+		if(q->x == p.x && q->y == p.y) return &rg->lookup[i];
+	}
+}
+
+
+int Roads_FindNode(RoadGraph* rg, EcPoint p, uint32_t* node) {
+	uint32_t n = *lookup_slot(rg, p);
+	if(!n) return 0;
+
+	*node = n - 1;
+	return 1;
+}
+
+
+uint32_t Roads_AssertNode(RoadGraph* rg, EcPoint p) {
+	uint32_t* slot = lookup_slot(rg, p);
+	if(*slot) return *slot - 1;
+
+	uint32_t n = VEC_LEN(&rg->nodes);
+	VEC_PUSH(&rg->nodes, p);
+
+	// keep the load under 70%
+	if(VEC_LEN(&rg->nodes) * 10 > rg->lookupAlloc * 7) {
+		free(rg->lookup);
+		rg->lookupAlloc *= 2;
+		rg->lookup = calloc(1, sizeof(*rg->lookup) * rg->lookupAlloc);
+
+		VEC_EACH(&rg->nodes, i, q) {
+			*lookup_slot(rg, q) = i + 1;
+		}
+	}
+	else {
+		*slot = n + 1;
+	}
+
+	return n;
+}
+
+
+void Roads_AddEdge(RoadGraph* rg, econid_t road, uint32_t a, uint32_t b, float len) {
+	if(a == b) return;
+
+	VEC_PUSH(&rg->edges, ((RoadEdge){.a = a, .b = b, .len = len, .road = road}));
+
+	// the side list is scanned on every visit, so keep it short
+	if(VEC_LEN(&rg->edges) - rg->csrEdges > 64 + rg->csrEdges / 8) {
+		Roads_Compact(rg);
+	}
+}
+
+
+// folds every edge into the CSR arrays
+void Roads_Compact(RoadGraph* rg) {
+	uint32_t nn = VEC_LEN(&rg->nodes);
+	uint32_t ne = VEC_LEN(&rg->edges);
+
+	free(rg->rowStart);
+	free(rg->adj);
+	rg->rowStart = calloc(1, sizeof(*rg->rowStart) * (nn + 1));
+	rg->adj = malloc(sizeof(*rg->adj) * ne * 2 + 1);
+
+	VEC_EACHP(&rg->edges, i, e) {
+		rg->rowStart[e->a + 1]++;
+		rg->rowStart[e->b + 1]++;
+	}
+
+	for(uint32_t i = 0; i < nn; i++) {
+		rg->rowStart[i + 1] += rg->rowStart[i];
+	}
+
+	// fill with a moving cursor per row, then shift the starts back
+	VEC_EACHP(&rg->edges, i, e) {
+		rg->adj[rg->rowStart[e->a]++] = i;
+		rg->adj[rg->rowStart[e->b]++] = i;
+	}
+
+	for(uint32_t i = nn; i > 0; i--) {
+		rg->rowStart[i] = rg->rowStart[i - 1];
+	}
+	rg->rowStart[0] = 0;
+
+	rg->csrNodes = nn;
+	rg->csrEdges = ne;
+}
+
+
+
+
+static void heap_push(RoadGraph* rg, float d, uint32_t n) {
+	VEC_PUSH(&rg->heap, ((struct RoadHeapEnt){d, n}));
+
+	struct RoadHeapEnt* h = VEC_DATA(&rg->heap);
+	size_t i = VEC_LEN(&rg->heap) - 1;
+	while(i > 0) {
+		size_t p = (i - 1) / 2;
+		if(h[p].d <= h[i].d) break;
+
+		struct RoadHeapEnt t = h[p];
+		h[p] = h[i];
+		h[i] = t;
+		i = p;
+	}
+}
+
+static struct RoadHeapEnt heap_pop(RoadGraph* rg) {
+	struct RoadHeapEnt* h = VEC_DATA(&rg->heap);
+	struct RoadHeapEnt top = h[0];
+
+	size_t n = --VEC_LEN(&rg->heap);
+	h[0] = h[n];
+
+	size_t i = 0;
+	while(1) {
+		size_t l = i * 2 + 1, r = l + 1, m = i;
+		if(l < n && h[l].d < h[m].d) m = l;
+		if(r < n && h[r].d < h[m].d) m = r;
+		if(m == i) break;
+
+		struct RoadHeapEnt t = h[m];
+		h[m] = h[i];
+		h[i] = t;
+		i = m;
+	}
+
+	return top;
+}
+
+
+static void relax_edge(RoadGraph* rg, RoadPathTree* t, uint32_t u, RoadEdge* e) {
+	uint32_t v = e->a == u ? e->b : e->a;
+	float nd = t->dist[u] + e->len;
+
+	if(nd < t->dist[v]) {
+		t->dist[v] = nd;
+		t->pred[v] = u;
+		heap_push(rg, nd, v);
+	}
+}
+
+
+// plain dijkstra from whatever is on the heap
+static void run_tree(RoadGraph* rg, RoadPathTree* t) {
+	while(VEC_LEN(&rg->heap)) {
+		struct RoadHeapEnt h = heap_pop(rg);
+		if(h.d > t->dist[h.n]) continue;
+
+		if(h.n < rg->csrNodes) {
+			for(uint32_t j = rg->rowStart[h.n]; j < rg->rowStart[h.n + 1]; j++) {
+				relax_edge(rg, t, h.n, &VEC_ITEM(&rg->edges, rg->adj[j]));
+			}
+		}
+
+		for(uint32_t j = rg->csrEdges; j < VEC_LEN(&rg->edges); j++) {
+			RoadEdge* e = &VEC_ITEM(&rg->edges, j);
+			if(e->a == h.n || e->b == h.n) relax_edge(rg, t, h.n, e);
+		}
+	}
+}
+
+
+static void size_tree(RoadPathTree* t, uint32_t nodeCnt) {
+	if(t->nodeCnt >= nodeCnt) return;
+
+	t->dist = realloc(t->dist, sizeof(*t->dist) * nodeCnt);
+	t->pred = realloc(t->pred, sizeof(*t->pred) * nodeCnt);
+
+	for(uint32_t i = t->nodeCnt; i < nodeCnt; i++) {
+		t->dist[i] = INFINITY;
+		t->pred[i] = UINT32_MAX;
+	}
+
+	t->nodeCnt = nodeCnt;
+}
+
+
+static RoadPathTree* find_tree(RoadGraph* rg, uint32_t src) {
+	for(int i = 0; i < rg->treeCnt; i++) {
+		RoadPathTree* t = &rg->trees[i];
+		if(t->src == src && t->epoch == rg->epoch) return t;
+	}
+
+	return NULL;
+}
+
+
+// returns an up to date tree rooted at src, computing or repairing it as needed
+static RoadPathTree* get_tree(RoadGraph* rg, uint32_t src) {
+	uint32_t nn = VEC_LEN(&rg->nodes);
+	uint32_t ne = VEC_LEN(&rg->edges);
+
+	RoadPathTree* t = find_tree(rg, src);
+
+	if(!t) {
+		// evict the least recently used tree
+		if(rg->treeCnt < ROADS_CACHE_SIZE) {
+			t = &rg->trees[rg->treeCnt++];
+		}
+		else {
+			t = &rg->trees[0];
+			for(int i = 1; i < ROADS_CACHE_SIZE; i++) {
+				if(rg->trees[i].lastUse < t->lastUse) t = &rg->trees[i];
+			}
+		}
+
+		size_tree(t, nn);
+		for(uint32_t i = 0; i < t->nodeCnt; i++) {
+			t->dist[i] = INFINITY;
+			t->pred[i] = UINT32_MAX;
+		}
+
+		t->src = src;
+		t->epoch = rg->epoch;
+		t->dist[src] = 0;
+
+		VEC_TRUNC(&rg->heap);
+		heap_push(rg, 0, src);
+		run_tree(rg, t);
+	}
+	else if(t->edgesSeen < ne) {
+		// edges were only added since, so distances can only shrink;
+		//   relax the new edges and propagate from whatever improved
+		size_tree(t, nn);
+
+		VEC_TRUNC(&rg->heap);
+		for(uint32_t j = t->edgesSeen; j < ne; j++) {
+			RoadEdge* e = &VEC_ITEM(&rg->edges, j);
+			relax_edge(rg, t, e->a, e);
+			relax_edge(rg, t, e->b, e);
+		}
+
+		run_tree(rg, t);
+	}
+
+	t->edgesSeen = ne;
+	t->lastUse = ++rg->useCounter;
+
+	return t;
+}
+
+
+static int tree_current(RoadGraph* rg, RoadPathTree* t) {
+	return t && t->edgesSeen == VEC_LEN(&rg->edges) && t->nodeCnt >= VEC_LEN(&rg->nodes);
+}
+
+
+// INFINITY when unreachable
+float Roads_Distance(RoadGraph* rg, uint32_t from, uint32_t to) {
+	uint32_t nn = VEC_LEN(&rg->nodes);
+	if(from >= nn || to >= nn) return INFINITY;
+	if(from == to) return 0;
+
+	// roads are two-way, so a tree rooted at either end will do;
+	//   prefer one that is up to date, then one that only needs repair
+	RoadPathTree* tt = find_tree(rg, to);
+	RoadPathTree* tf = find_tree(rg, from);
+	if(!tree_current(rg, tt) && tree_current(rg, tf)) tt = NULL;
+
+	if(tt || !tf) {
+		// new trees are rooted at the destination: many sellers ship to a
+		//   few buyers and sinks, and Roads_Path roots there too
+		return get_tree(rg, to)->dist[from];
+	}
+
+	return get_tree(rg, from)->dist[to];
+}
+
+
+// writes the nodes from one end to the other into out, truncated to maxOut
+// returns the full node count, 0 when unreachable
+int Roads_Path(RoadGraph* rg, uint32_t from, uint32_t to, uint32_t* out, int maxOut) {
+	uint32_t nn = VEC_LEN(&rg->nodes);
+	if(from >= nn || to >= nn) return 0;
+
+	// walking the predecessors of a tree rooted at the destination
+	//   gives the path in travel order
+	RoadPathTree* t = get_tree(rg, to);
+	if(t->dist[from] == INFINITY) return 0;
+
+	int n = 0;
+	for(uint32_t u = from; u != UINT32_MAX; u = t->pred[u]) {
+		if(n < maxOut) out[n] = u;
+		n++;
+	}
+
+	return n;
+}
+
+
+
+
+static Comp* road_comp(Economy* ec, Entity* e, int internalType) {
+	VEC_EACHP(&e->comps, i, c) {
+		CompDef* cd = Econ_GetCompDef(ec, c->type);
+		if(cd && cd->type == internalType && c->vp) return c;
+	}
+
+	return NULL;
+}
+
+
+static float pt_dist(EcPoint a, EcPoint b) {
+	return sqrtf((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y));
+}
+
+
+static void add_span(Economy* ec, Entity* e) {
+	RoadGraph* rg = &ec->roadGraph;
+
+	Comp* c = road_comp(ec, e, CT_roadspan);
+	if(!c) return;
+
+	RoadSpan* s = c->roadSpan;
+	uint32_t a = Roads_AssertNode(rg, s->a);
+	uint32_t b = Roads_AssertNode(rg, s->b);
+	Roads_AddEdge(rg, e->id, a, b, pt_dist(s->a, s->b));
+
+	VEC_PUSH(&ec->roads, e->id);
+}
+
+
+// the junction is joined to both ends of both roads; the old end to end
+//   edges stay, which is harmless since a point on a span is never a shortcut
+static void add_connect(Economy* ec, Entity* e) {
+	RoadGraph* rg = &ec->roadGraph;
+
+	Comp* cc = road_comp(ec, e, CT_roadconnect);
+	if(!cc || !cc->roadConnect->to || cc->roadConnect->to >= ec->entitySlots) return;
+
+	Entity* other = Econ_GetEntity(ec, cc->roadConnect->to);
+	if(other->dead) return;
+
+	EcPoint w = cc->roadConnect->where;
+	uint32_t wn = Roads_AssertNode(rg, w);
+
+	Entity* ends[2] = {e, other};
+	for(int i = 0; i < 2; i++) {
+		Comp* c = road_comp(ec, ends[i], CT_roadspan);
+		if(!c) continue;
+
+		RoadSpan* s = c->roadSpan;
+		Roads_AddEdge(rg, ends[i]->id, wn, Roads_AssertNode(rg, s->a), pt_dist(w, s->a));
+		Roads_AddEdge(rg, ends[i]->id, wn, Roads_AssertNode(rg, s->b), pt_dist(w, s->b));
+	}
+}
+
+
+void Econ_BuildRoads(Economy* ec) {
+	Roads_Clear(&ec->roadGraph);
+	VEC_TRUNC(&ec->roads);
+
+	VECMP_EACH(&ec->entities, i, e) {
+		if(!e->dead) add_span(ec, e);
+	}
+
+	VEC_EACH(&ec->roads, i, id) {
+		add_connect(ec, Econ_GetEntity(ec, id));
+	}
+
+	Roads_Compact(&ec->roadGraph);
+	ec->roadGraph.dirty = 0;
+}
+
+
+// a road component was added to e; replacements and removals mark the graph dirty instead
+void Econ_RoadAdded(Economy* ec, Entity* e, int internalType) {
+	if(ec->roadGraph.dirty) return;
+
+	if(internalType == CT_roadspan) {
+		add_span(ec, e);
+		add_connect(ec, e);
+	}
+	else if(internalType == CT_roadconnect) {
+		add_connect(ec, e);
+	}
+}
+
+
+// the closer end of the nearest road
+static int snap(Economy* ec, econid_t id, uint32_t* node, float* access) {
+	if(!id || id >= ec->entitySlots) return 0;
+
+	EcPoint p;
+	if(!Econ_EntityPosition(ec, Econ_GetEntity(ec, id), &p)) return 0;
+
+	econid_t road;
+	float d;
+	if(!Spatial_Nearest(&ec->spatial, SPATIAL_ROAD, p, 1, &road, &d)) return 0;
+
+	Comp* c = road_comp(ec, Econ_GetEntity(ec, road), CT_roadspan);
+	if(!c) return 0;
+
+	EcPoint a = c->roadSpan->a;
+	EcPoint b = c->roadSpan->b;
+	EcPoint end = pt_dist(p, a) <= pt_dist(p, b) ? a : b;
+
+	*access = pt_dist(p, end);
+	return Roads_FindNode(&ec->roadGraph, end, node);
+}
+
+
+// travel distance between two positioned entities over the road network,
+//   including the legs to and from the nearest roads
+// returns -1 when there is no route
+float Econ_TransportCost(Economy* ec, econid_t from, econid_t to) {
+	if(ec->roadGraph.dirty) Econ_BuildRoads(ec);
+
+	uint32_t a, b;
+	float accA, accB;
+	if(!snap(ec, from, &a, &accA) || !snap(ec, to, &b, &accB)) return -1;
+
+	float d = Roads_Distance(&ec->roadGraph, a, b);
+	if(d == INFINITY) return -1;
+
+	return accA + d + accB;
+}
+
+
+// fills out with road graph nodes between the entities; see Roads_Path
+int Econ_Route(Economy* ec, econid_t from, econid_t to, uint32_t* out, int maxOut) {
+	if(ec->roadGraph.dirty) Econ_BuildRoads(ec);
+
+	uint32_t a, b;
+	float accA, accB;
+	if(!snap(ec, from, &a, &accA) || !snap(ec, to, &b, &accB)) return 0;
+
+	return Roads_Path(&ec->roadGraph, a, b, out, maxOut);
+}
@@ -0,0 +1,71 @@
+
+
+
+// road network compiled from roadspan and roadconnect components
+//   nodes are span endpoints and junctions, deduplicated by position
+//   edges are kept in CSR form, with recent additions in a short side list
+//     until the next compaction
+
+
+
+typedef struct RoadEdge {
+	uint32_t a, b;
+	float len;
+	econid_t road;
+} RoadEdge;
+
+
+// a cached single source shortest path tree
+typedef struct RoadPathTree {
+	uint32_t src;
+	uint32_t epoch;
+	uint32_t edgesSeen; // edges already relaxed into dist
+	uint32_t nodeCnt; // size of dist and pred
+	uint64_t lastUse;
+	float* dist;
+	uint32_t* pred; // UINT32_MAX for none
+} RoadPathTree;
+
+
+#define ROADS_CACHE_SIZE 64
+
+typedef struct RoadGraph {
+	VEC(EcPoint) nodes;
+
+	// position -> node + 1
+	uint32_t* lookup;
+	uint32_t lookupAlloc;
+
+	// every edge ever added; the first csrEdges are compiled into the CSR
+	VEC(RoadEdge) edges;
+	uint32_t csrEdges;
+	uint32_t csrNodes;
+	uint32_t* rowStart; // csrNodes + 1 entries
+	uint32_t* adj; // edge indices, both directions
+
+	// bumped whenever edges are removed; cached trees from older epochs are discarded
+	uint32_t epoch;
+	char dirty; // needs a full rebuild from the components
+
+	uint64_t useCounter;
+	int treeCnt;
+	RoadPathTree trees[ROADS_CACHE_SIZE];
+
+	VEC(struct RoadHeapEnt { float d; uint32_t n; }) heap;
+} RoadGraph;
+
+
+
+
+void Roads_Init(RoadGraph* rg);
+void Roads_Destroy(RoadGraph* rg);
+void Roads_Clear(RoadGraph* rg);
+
+uint32_t Roads_AssertNode(RoadGraph* rg, EcPoint p);
+int Roads_FindNode(RoadGraph* rg, EcPoint p, uint32_t* node);
+void Roads_AddEdge(RoadGraph* rg, econid_t road, uint32_t a, uint32_t b, float len);
+void Roads_Compact(RoadGraph* rg);
+
+float Roads_Distance(RoadGraph* rg, uint32_t from, uint32_t to);
+int Roads_Path(RoadGraph* rg, uint32_t from, uint32_t to, uint32_t* out, int maxOut);
+
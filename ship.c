@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+
+#include "econ.h"
+
+
+
+
+void ShipQueue_Init(ShipQueue* sq) {
+	sq->speed = 10;
+	sq->inTransit = 0;
+	
+	for(int i = 0; i < SHIP_RING_SIZE; i++) {
+		VEC_INIT(&sq->ring[i]);
+	}
+	VEC_INIT(&sq->far);
+}
+
+
+void ShipQueue_Destroy(ShipQueue* sq) {
+	for(int i = 0; i < SHIP_RING_SIZE; i++) {
+		VEC_FREE(&sq->ring[i]);
+	}
+	VEC_FREE(&sq->far);
+}
+
+
+// arrivals at or before now land on the next tick
+void Ship_Add(ShipQueue* sq, tick_t now, Shipment* s) {
+	if(s->arrival <= now) s->arrival = now + 1;
+	
+	if(s->arrival - now < SHIP_RING_SIZE) {
+		VEC_PUSH(&sq->ring[s->arrival & (SHIP_RING_SIZE - 1)], *s);
+	}
+	else {
+		VEC_PUSH(&sq->far, *s);
+	}
+	
+	sq->inTransit++;
+}
+
+
+
+
+static void ship_fill(Economy* ec, MarketFill* f) {
+	ShipQueue* sq = &ec->ships;
+	tick_t travel = 1;
+	
+	float dist = Econ_TransportCost(ec, f->seller, f->buyer);
+	if(dist > 0 && sq->speed > 0) travel = MAX(1, ceilf(dist / sq->speed));
+	
+	Shipment s = {
+		.from = f->seller,
+		.to = f->buyer,
+		.item = f->item,
+		.qty = f->qty,
+		.price = f->price,
+		.departed = ec->tick,
+		.arrival = ec->tick + travel,
+	};
+	
+	Ship_Add(sq, ec->tick, &s);
+	
+	// clearing runs in parallel, so its totals and the seller's fill
+	//   are settled here
+	Totals_Delta(&ec->totals, f->item, TOT_ESCROW, -f->qty);
+	Totals_Delta(&ec->totals, f->item, TOT_TRANSIT, f->qty);
+	
+	Inventory* inv = Entity_Inv(ec, Econ_GetEntity(ec, f->seller));
+	if(inv) Inv_AdjustFill(inv, f->item, -f->qty);
+}
+
+
+// turns this tick's market fills into shipments, market by market
+void Econ_ShipFills(Economy* ec) {
+	VEC_EACH(&ec->markets, mi, m) {
+		VEC_EACHP(&m->fills, i, f) {
+			ship_fill(ec, f);
+		}
+		
+		VEC_TRUNC(&m->fills);
+	}
+}
+
+
+// hands over everything arriving this tick
+void Econ_DeliverShipments(Economy* ec) {
+	ShipQueue* sq = &ec->ships;
+	tick_t now = ec->tick;
+	
+	// pull the next revolution's arrivals in from the far list
+	if((now & (SHIP_RING_SIZE - 1)) == 0) {
+		for(intptr_t i = 0; i < VEC_LEN(&sq->far); i++) {
+			Shipment* s = &VEC_ITEM(&sq->far, i);
+			if(s->arrival - now >= SHIP_RING_SIZE) continue;
+			
+			VEC_PUSH(&sq->ring[s->arrival & (SHIP_RING_SIZE - 1)], *s);
+			
+			*s = VEC_TAIL(&sq->far);
+			VEC_LEN(&sq->far)--;
+			i--; // retry this index
+		}
+	}
+	
+	int b = now & (SHIP_RING_SIZE - 1);
+	
+	VEC_EACHP(&sq->ring[b], i, s) {
+		Entity* e = s->to < ec->entitySlots ? Econ_GetEntity(ec, s->to) : NULL;
+		
+		if(e && !e->dead && e != ec->m->sinkEntity) {
+			Entity_InvReceive(ec, e, s->item, s->qty);
+			continue;
+		}
+		
+		// sinks use up what they buy; goods for destroyed buyers are lost
+		Totals_Delta(&ec->totals, s->item, TOT_TRANSIT, -s->qty);
+		Totals_Delta(&ec->totals, s->item, e == ec->m->sinkEntity ? TOT_CONSUMED : TOT_DESTROYED, s->qty);
+	}
+	
+	sq->inTransit -= VEC_LEN(&sq->ring[b]);
+	VEC_TRUNC(&sq->ring[b]);
+}
+
@@ -0,0 +1,45 @@
+
+
+// goods bought on the market travel from the seller to the buyer
+//   shipments sit in a ring of per-tick buckets keyed by arrival, so a tick
+//   only touches the deliveries landing on it
+
+
+
+typedef struct Shipment {
+	econid_t from, to;
+	econid_t item;
+	long qty;
+	money_t price; // total paid
+	tick_t departed, arrival;
+} Shipment;
+
+
+// must be a power of two
+#define SHIP_RING_SIZE 1024
+
+typedef struct ShipQueue {
+	float speed; // distance per tick
+	
+	long inTransit; // shipment count
+	
+	// bucket i holds arrivals on ticks t where t % SHIP_RING_SIZE == i,
+	//   for t less than SHIP_RING_SIZE ticks ahead
+	VEC(Shipment) ring[SHIP_RING_SIZE];
+	
+	// arrivals beyond the ring, moved in once per revolution
+	VEC(Shipment) far;
+} ShipQueue;
+
+
+
+
+void ShipQueue_Init(ShipQueue* sq);
+void ShipQueue_Destroy(ShipQueue* sq);
+
+void Ship_Add(ShipQueue* sq, tick_t now, Shipment* s);
+
+struct Economy;
+void Econ_ShipFills(struct Economy* ec);
+void Econ_DeliverShipments(struct Economy* ec);
+
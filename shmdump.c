@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#include "publish.h"
+
+
+
+// reads the state an econsim process publishes to shared memory
+//   it only maps the region; it never talks to the sim
+
+
+static void usage(void) {
+	fprintf(stderr,
+		"usage: shmdump [options] name\n"
+		"  -w ms     print again every ms milliseconds\n"
+		"  -n rows   entity rows to print (20)\n"
+	);
+}
+
+
+static char* buckets[] = {"inv", "escrow", "transit", "consumed", "created", "destroyed"};
+
+
+// copies a consistent snapshot of the region into buf
+static void read_region(PubHeader* h, char* buf, size_t size) {
+	while(1) {
+		uint64_t s = Pub_ReadBegin(h);
+		memcpy(buf, h, size);
+		if(!Pub_ReadRetry(h, s)) return;
+	}
+}
+
+
+static void dump(PubHeader* h, int maxRows) {
+	printf("tick %u%s\n", h->tick, h->flags & PUBF_TRUNCATED ? " (truncated)" : "");
+	
+	printf("\n%8s", "item");
+	for(int b = 0; b < 6; b++) printf(" %10s", buckets[b]);
+	printf(" %10s %10s %10s\n", "last", "vwap", "volume");
+	
+	PubItem* items = Pub_Items(h);
+	for(uint32_t i = 0; i < h->itemCnt; i++) {
+		printf("%8u", items[i].item);
+		for(int b = 0; b < 6; b++) printf(" %10ld", (long)items[i].totals[b]);
+		printf(" %10ld %10ld %10ld\n", (long)items[i].last, (long)items[i].vwap, (long)items[i].volume);
+	}
+	
+	printf("\n%8s %8s %10s %10s %10s\n", "region", "item", "ask", "qty", "orders");
+	
+	PubBookTop* books = Pub_Books(h);
+	for(uint32_t i = 0; i < h->bookCnt; i++) {
+		PubBookTop* b = &books[i];
+		printf("%8u %8u %10ld %10ld %10ld\n", b->region, b->item, (long)b->bestAsk, (long)b->askQty, (long)b->orders);
+	}
+	
+	if(!h->colCnt) return;
+	
+	printf("\n%8s", "entity");
+	for(uint32_t c = 0; c < h->colCnt; c++) printf(" %12.12s", h->colNames[c]);
+	printf("\n");
+	
+	uint32_t* ids = Pub_RowIds(h);
+	for(uint32_t r = 0; r < h->rowCnt && r < maxRows; r++) {
+		printf("%8u", ids[r]);
+		
+		double* row = Pub_Row(h, r);
+		for(uint32_t c = 0; c < h->colCnt; c++) printf(" %12g", row[c]);
+		printf("\n");
+	}
+	if(h->rowCnt > maxRows) printf("... %u more\n", h->rowCnt - maxRows);
+}
+
+
+int main(int argc, char* argv[]) {
+	int waitMs = 0;
+	int maxRows = 20;
+	
+	int opt;
+	while((opt = getopt(argc, argv, "w:n:")) != -1) {
+		switch(opt) {
+			case 'w': waitMs = atoi(optarg); break;
+			case 'n': maxRows = atoi(optarg); break;
+			default: usage(); return 1;
+		}
+	}
+	
+	if(optind >= argc) {
+		usage();
+		return 1;
+	}
+	
+	char* name = argv[optind];
+	
+	int fd = shm_open(name, O_RDONLY, 0);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Could not open shared memory '%s'\n", name);
+		return 1;
+	}
+	
+	PubHeader* h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(h == MAP_FAILED || st.st_size < sizeof(*h) || h->magic != PUB_MAGIC || h->version != PUB_VERSION) {
+		fprintf(stderr, "'%s' is not an econsim state region\n", name);
+		return 1;
+	}
+	
+	char* buf = malloc(h->size);
+	
+	do {
+		read_region(h, buf, h->size);
+		dump((PubHeader*)buf, maxRows);
+		
+		if(waitMs) {
+			printf("\n");
+			fflush(stdout);
+			usleep(waitMs * 1000);
+		}
+	} while(waitMs);
+	
+	return 0;
+}
@@ -0,0 +1,299 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+
+#include "sim.h"
+
+
+
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_sec(double t) {
+	if(t <= 0) return;
+
+	struct timespec ts;
+	ts.tv_sec = t;
+	ts.tv_nsec = (t - ts.tv_sec) * 1e9;
+	nanosleep(&ts, NULL);
+}
+
+
+static uint64_t pack_view(int tab, int scrollh, int scrollv) {
+	return ((uint64_t)(tab & 0xffff) << 48) | ((uint64_t)(scrollh & 0xffff) << 32) | (uint32_t)scrollv;
+}
+
+
+
+// resolves entity type and column names to ids once, up front
+void View_Compile(Economy* ec, View* v) {
+	v->entType = Economy_EntityType(ec, v->name);
+
+	v->colCnt = 0;
+	while(v->cols[v->colCnt]) v->colCnt++;
+
+	v->ccols = calloc(1, sizeof(*v->ccols) * (v->colCnt + 1));
+
+	for(int i = 0; i < v->colCnt; i++) {
+		if(Query_ResolveColumn(ec, v->cols[i], &v->ccols[i])) {
+			LOG("View '%s': unknown column '%s'", v->name, v->cols[i]);
+		}
+	}
+
+	if(!v->sortBy) return;
+
+	// the rows: everything with the sort column, best first, cut to the
+	//   window before each snapshot
+	Query_Init(&v->q, ec, v->name);
+	Query_Where(&v->q, ec, v->sortBy, QOP_HAS, 0);
+	int c = Query_Select(&v->q, ec, v->sortBy);
+	Query_Aggregate(&v->q, ec, v->sortBy, QAGG_SUM);
+	Query_OrderBy(&v->q, c, v->desc, SNAP_ROWS);
+
+	QueryResult_Init(&v->res);
+}
+
+
+
+static void fill_cell(Economy* ec, Entity* e, QueryCol* vc, SnapCell* sc) {
+	memset(sc, 0, sizeof(*sc));
+
+	if(vc->kind == QCOL_ITEM) {
+		Inventory* inv = Entity_Inv(ec, e);
+		InvItem* item = Inv_GetItemP(inv, vc->id);
+		EscrowItem* eitem = Inv_GetEscrowItemP(inv, e->id, vc->id);
+
+		if(item) {
+			sc->kind = eitem ? SNAP_INVESCROW : SNAP_INV;
+			sc->inv.count = item->count;
+			sc->inv.escrow = eitem ? eitem->count : 0;
+		}
+
+		return;
+	}
+
+	if(vc->kind == QCOL_TOTAL || vc->kind == QCOL_TRADE) {
+		if(vc->kind == QCOL_TRADE && !Trades_Stats(&ec->trades, e->id)) return;
+		
+		sc->kind = SNAP_INT;
+		sc->n = Query_ColumnValue(ec, e, vc);
+		return;
+	}
+	
+	if(vc->kind == QCOL_COMPITEM) {
+		if(!Entity_GetComp(e, vc->id)) return;
+		
+		sc->kind = SNAP_ID;
+		sc->id = Query_ColumnValue(ec, e, vc);
+		return;
+	}
+	
+	if(vc->kind != QCOL_COMP) return;
+
+	Comp* c = Entity_GetComp(e, vc->id);
+	if(!c) return;
+
+	// arrays show their first element
+	int n;
+	void* p = Comp_Data(ec, c, &n);
+	if(!n) return;
+	sc->more = n - 1;
+	
+	CompDef* cd = Econ_GetCompDef(ec, c->type);
+	switch(cd->type) {
+		default:
+			LOG("snapshot: unsupported component type: %d", cd->type);
+			break;
+
+		case CT_int: sc->kind = SNAP_INT; sc->n = *(int64_t*)p; break;
+		case CT_float: sc->kind = SNAP_FLOAT; sc->d = *(double*)p; break;
+		case CT_id: sc->kind = SNAP_ID; sc->id = *(econid_t*)p; break;
+		case CT_str:
+			sc->kind = SNAP_STR;
+			if(c->str) strncpy(sc->str, c->str, SNAP_STRLEN - 1);
+			break;
+		case CT_itemRate:
+			sc->kind = SNAP_ITEMRATE;
+			sc->itemRate.item = ((ItemRate*)p)->item;
+			sc->itemRate.rate = ((ItemRate*)p)->rate;
+			break;
+	}
+}
+
+
+// runs on the sim thread, between ticks
+static void fill_snapshot(SimThread* st, Snapshot* s, uint64_t req, float tps) {
+	Economy* ec = st->ec;
+
+	s->tick = ec->tick;
+	s->ticksPerSec = tps;
+	s->tab = req >> 48;
+	s->scrollh = (req >> 32) & 0xffff;
+	s->scrollv = req & 0xffffffff;
+	s->rowCnt = 0;
+
+	s->matched = 0;
+	s->sortSum = 0;
+
+	View* v = &st->views[s->tab];
+	EntityDef* ed = Economy_GetEntityDef(ec, v->entType);
+	if(!ed) return;
+	
+	// ranked views take their rows from the query, unranked ones walk the
+	//   instance list and only touch the visible rows
+	econid_t* ids = VEC_DATA(&ed->instances);
+	intptr_t idCnt = VEC_LEN(&ed->instances);
+	
+	if(v->sortBy) {
+		Query_OrderBy(&v->q, v->q.orderCol, v->desc, s->scrollv + SNAP_ROWS);
+		Query_Run(ec, &v->q, &v->res);
+		
+		ids = VEC_DATA(&v->res.ids);
+		idCnt = v->res.rowCnt;
+		s->matched = v->res.matched;
+		s->sortSum = VEC_ITEM(&v->res.aggs, 0);
+	}
+
+	for(intptr_t r = s->scrollv; r < idCnt && s->rowCnt < SNAP_ROWS; r++) {
+		Entity* e = Econ_GetEntity(ec, ids[r]);
+
+		SnapCell* row = s->cells[s->rowCnt++];
+		for(int n = 0; n < SNAP_COLS; n++) {
+			if(s->scrollh + n < v->colCnt) {
+				fill_cell(ec, e, &v->ccols[s->scrollh + n], &row[n]);
+			}
+			else {
+				row[n].kind = SNAP_NONE;
+				row[n].more = 0;
+			}
+		}
+	}
+}
+
+
+static void publish(SimThread* st, uint64_t req, float tps) {
+	fill_snapshot(st, &st->bufs[st->back], req, tps);
+
+	int prev = atomic_exchange(&st->shared, st->back | SNAP_FRESH);
+	st->back = prev & ~SNAP_FRESH;
+}
+
+
+
+static void* sim_thread(void* _st) {
+	SimThread* st = _st;
+
+	uint64_t lastReq = ~0ull;
+	int sincePublish = 0;
+
+	double deadline = now_sec();
+	double rateStart = deadline;
+	int rateTicks = 0;
+	float tps = 0;
+
+	while(!atomic_load(&st->quit)) {
+		int ticked = 0;
+
+		if(!atomic_load(&st->paused)) {
+			Economy_tick(st->ec);
+			ticked = 1;
+		}
+		else if(atomic_load(&st->steps) > 0) {
+			atomic_fetch_sub(&st->steps, 1);
+			Economy_tick(st->ec);
+			ticked = 1;
+		}
+
+		double t = now_sec();
+		rateTicks += ticked;
+		if(t - rateStart >= 1.0) {
+			tps = rateTicks / (t - rateStart);
+			rateTicks = 0;
+			rateStart = t;
+		}
+
+		// publish on schedule, after a manual step, or when the ui looks elsewhere
+		uint64_t req = atomic_load(&st->uiReq);
+		sincePublish += ticked;
+		if(sincePublish >= st->publishEvery || req != lastReq || (ticked && atomic_load(&st->paused))) {
+			publish(st, req, tps);
+			lastReq = req;
+			sincePublish = 0;
+		}
+
+		// pacing
+		int rate = atomic_load(&st->tickRate);
+		if(!ticked) {
+			sleep_sec(0.005);
+			deadline = now_sec();
+		}
+		else if(rate > 0) {
+			deadline += 1.0 / rate;
+
+			// don't try to catch up after falling far behind
+			if(deadline < t - 1.0) deadline = t;
+
+			sleep_sec(deadline - t);
+		}
+		else {
+			deadline = t;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+void Sim_Start(SimThread* st, Economy* ec, View* views, int tickRate, int publishEvery) {
+	memset(st, 0, sizeof(*st));
+
+	st->ec = ec;
+	st->views = views;
+	st->publishEvery = MAX(1, publishEvery);
+
+	for(View* v = views; v->name; v++) {
+		View_Compile(ec, v);
+	}
+
+	atomic_store(&st->tickRate, tickRate);
+	atomic_store(&st->paused, 1);
+	atomic_store(&st->uiReq, pack_view(0, 0, 0));
+
+	st->front = 0;
+	st->back = 1;
+	atomic_store(&st->shared, 2);
+
+	// the ui must have something to draw before the first publish
+	fill_snapshot(st, &st->bufs[st->front], pack_view(0, 0, 0), 0);
+
+	pthread_create(&st->thread, NULL, sim_thread, st);
+}
+
+
+void Sim_Stop(SimThread* st) {
+	atomic_store(&st->quit, 1);
+	pthread_join(st->thread, NULL);
+}
+
+
+void Sim_SetView(SimThread* st, int tab, int scrollh, int scrollv) {
+	atomic_store(&st->uiReq, pack_view(tab, scrollh, scrollv));
+}
+
+
+// the returned snapshot stays valid until the next call
+Snapshot* Sim_GetSnapshot(SimThread* st) {
+	if(atomic_load(&st->shared) & SNAP_FRESH) {
+		int prev = atomic_exchange(&st->shared, st->front);
+		st->front = prev & ~SNAP_FRESH;
+	}
+
+	return &st->bufs[st->front];
+}
+
@@ -0,0 +1,123 @@
+#ifndef __econsim_sim_h__
+#define __econsim_sim_h__
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "econ.h"
+
+
+
+// the ui shows a window of 21 rows, 6 columns wide
+#define SNAP_ROWS 21
+#define SNAP_COLS 6
+#define SNAP_STRLEN 32
+
+// set on the shared buffer index when it holds an unread snapshot
+#define SNAP_FRESH 0x4
+
+
+typedef struct View {
+	char* name;
+	char* dispName;
+	char** cols;
+	
+	// optional ranking column; rows without it are left out
+	char* sortBy;
+	int desc;
+
+	// filled in by View_Compile
+	int entType;
+	int colCnt;
+	QueryCol* ccols; // column names are the query engine's
+	
+	// ranked views find their rows through a query
+	Query q;
+	QueryResult res;
+
+} View;
+
+
+enum SnapCellKind {
+	SNAP_NONE = 0,
+	SNAP_INT,
+	SNAP_FLOAT,
+	SNAP_ID,
+	SNAP_STR,
+	SNAP_ITEMRATE,
+	SNAP_INV,
+	SNAP_INVESCROW,
+};
+
+typedef struct SnapCell {
+	enum SnapCellKind kind;
+	union {
+		int64_t n;
+		double d;
+		econid_t id;
+		struct { econid_t item; float rate; } itemRate;
+		struct { long count, escrow; } inv;
+	};
+	
+	int more; // array elements after the first, which is the one shown
+
+	// strings are copied so the ui never points into live entity data
+	char str[SNAP_STRLEN];
+} SnapCell;
+
+
+// an immutable copy of everything the ui draws for one frame
+typedef struct Snapshot {
+	tick_t tick;
+	float ticksPerSec;
+
+	// the window this snapshot was filled for
+	int tab, scrollh, scrollv;
+
+	int rowCnt;
+	SnapCell cells[SNAP_ROWS][SNAP_COLS];
+	
+	// ranked views only
+	long matched;
+	double sortSum;
+} Snapshot;
+
+
+typedef struct SimThread {
+	Economy* ec;
+	View* views;
+
+	pthread_t thread;
+
+	atomic_int quit;
+	atomic_int paused;
+	atomic_int steps; // single steps requested while paused
+	atomic_int tickRate; // target ticks per second, 0 is unlimited
+	int publishEvery; // ticks between snapshots
+
+	// packed tab/scroll position the ui wants to see
+	atomic_uint_fast64_t uiReq;
+
+	// triple buffer: the sim thread owns back, the ui owns front,
+	//   and the middle one is traded through shared
+	Snapshot bufs[3];
+	atomic_int shared;
+	int back;
+	int front;
+
+} SimThread;
+
+
+
+void View_Compile(Economy* ec, View* v);
+
+void Sim_Start(SimThread* st, Economy* ec, View* views, int tickRate, int publishEvery);
+void Sim_Stop(SimThread* st);
+
+void Sim_SetView(SimThread* st, int tab, int scrollh, int scrollv);
+Snapshot* Sim_GetSnapshot(SimThread* st);
+
+
+
+#endif // __econsim_sim_h__
@@ -0,0 +1,561 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+
+#include "econ.h"
+
+
+
+
+void Spatial_Init(SpatialIndex* si, float cellSize) {
+	memset(si, 0, sizeof(*si));
+
+	si->cellSize = cellSize > 0 ? cellSize : 10;
+	si->invCell = 1.0f / si->cellSize;
+
+	si->cellAlloc = 1024;
+	si->cells = calloc(1, sizeof(*si->cells) * si->cellAlloc);
+
+	for(int k = 0; k < SPATIAL_MAXVALUE; k++) {
+		si->bounds[k] = (SpatialBounds){INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+	}
+
+	VEC_INIT(&si->items);
+	VEC_INIT(&si->freeItems);
+	VEC_INIT(&si->stamps);
+}
+
+
+void Spatial_Destroy(SpatialIndex* si) {
+	for(uint32_t i = 0; i < si->cellAlloc; i++) {
+		if(si->cells[i].used) VEC_FREE(&si->cells[i].items);
+	}
+	free(si->cells);
+
+	for(int k = 0; k < SPATIAL_MAXVALUE; k++) {
+		free(si->handles[k]);
+	}
+
+	VEC_FREE(&si->items);
+	VEC_FREE(&si->freeItems);
+	VEC_FREE(&si->stamps);
+}
+
+
+
+
+static uint32_t cell_hash(int32_t cx, int32_t cy) {
+	uint64_t k = ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdull;
+	k ^= k >> 33;
+	return k;
+}
+
+static int32_t to_cell(SpatialIndex* si, float v) {
+	return floorf(v * si->invCell);
+}
+
+
+static SpatialCell* find_cell(SpatialIndex* si, int32_t cx, int32_t cy) {
+	uint32_t mask = si->cellAlloc - 1;
+
+	for(uint32_t i = cell_hash(cx, cy) & mask; ; i = (i + 1) & mask) {
+		SpatialCell* c = &si->cells[i];
+		if(!c->used) return NULL;
+		if(c->cx == cx && c->cy == cy) return c;
+	}
+}
+
+
+static void grow_cells(SpatialIndex* si) {
+	SpatialCell* old = si->cells;
+	uint32_t oldAlloc = si->cellAlloc;
+
+	si->cellAlloc *= 2;
+	si->cells = calloc(1, sizeof(*si->cells) * si->cellAlloc);
+
+	uint32_t mask = si->cellAlloc - 1;
+	for(uint32_t j = 0; j < oldAlloc; j++) {
+		if(!old[j].used) continue;
+
+		uint32_t i = cell_hash(old[j].cx, old[j].cy) & mask;
+		while(si->cells[i].used) i = (i + 1) & mask;
+
+		si->cells[i] = old[j];
+	}
+
+	free(old);
+}
+
+
+static SpatialCell* assert_cell(SpatialIndex* si, int32_t cx, int32_t cy) {
+	SpatialCell* c = find_cell(si, cx, cy);
+	if(c) return c;
+
+	// keep the load under 70%
+	if((si->cellCnt + 1) * 10 > si->cellAlloc * 7) grow_cells(si);
+
+	uint32_t mask = si->cellAlloc - 1;
+	uint32_t i = cell_hash(cx, cy) & mask;
+	while(si->cells[i].used) i = (i + 1) & mask;
+
+	c = &si->cells[i];
+	c->used = 1;
+	c->cx = cx;
+	c->cy = cy;
+	VEC_INIT(&c->items);
+
+	si->cellCnt++;
+
+	return c;
+}
+
+
+
+
+static uint32_t* handle_slot(SpatialIndex* si, int kind, econid_t id) {
+	if(id >= si->handleAlloc[kind]) {
+		uint32_t n = MAX(1024, si->handleAlloc[kind]);
+		while(n <= id) n *= 2;
+
+		si->handles[kind] = realloc(si->handles[kind], sizeof(uint32_t) * n);
+		memset(si->handles[kind] + si->handleAlloc[kind], 0, sizeof(uint32_t) * (n - si->handleAlloc[kind]));
+		si->handleAlloc[kind] = n;
+	}
+
+	return &si->handles[kind][id];
+}
+
+
+typedef void (*cell_fn)(SpatialIndex* si, int32_t cx, int32_t cy, uint32_t h);
+
+static void link_cell(SpatialIndex* si, int32_t cx, int32_t cy, uint32_t h) {
+	SpatialCell* c = assert_cell(si, cx, cy);
+	VEC_PUSH(&c->items, h);
+
+	SpatialBounds* bb = &si->bounds[VEC_ITEM(&si->items, h).kind];
+	bb->minCx = MIN(bb->minCx, cx);
+	bb->minCy = MIN(bb->minCy, cy);
+	bb->maxCx = MAX(bb->maxCx, cx);
+	bb->maxCy = MAX(bb->maxCy, cy);
+}
+
+static void unlink_cell(SpatialIndex* si, int32_t cx, int32_t cy, uint32_t h) {
+	SpatialCell* c = find_cell(si, cx, cy);
+	if(!c) return;
+
+	VEC_EACH(&c->items, i, ch) {
+		if(ch != h) continue;
+		VEC_ITEM(&c->items, i) = VEC_TAIL(&c->items);
+		VEC_LEN(&c->items)--;
+		break;
+	}
+}
+
+
+// visits every cell the item's segment passes through, once each
+// a segment through a cell corner also visits the two cells beside it,
+//   so nothing within reach of the span is missed
+static void walk_item(SpatialIndex* si, uint32_t h, cell_fn fn) {
+	EcPoint a = VEC_ITEM(&si->items, h).a;
+	EcPoint b = VEC_ITEM(&si->items, h).b;
+
+	int32_t cx = to_cell(si, a.x);
+	int32_t cy = to_cell(si, a.y);
+	int32_t ex = to_cell(si, b.x);
+	int32_t ey = to_cell(si, b.y);
+
+	int32_t sx = ex > cx ? 1 : -1;
+	int32_t sy = ey > cy ? 1 : -1;
+	int64_t n = llabs((int64_t)ex - cx) + llabs((int64_t)ey - cy);
+
+	// distance along the segment, in segment lengths, to the next cell edge
+	//   on each axis, and between edges
+	float dx = fabsf(b.x - a.x);
+	float dy = fabsf(b.y - a.y);
+	float tx = dx > 0 ? (sx > 0 ? (cx + 1) * si->cellSize - a.x : a.x - cx * si->cellSize) / dx : INFINITY;
+	float ty = dy > 0 ? (sy > 0 ? (cy + 1) * si->cellSize - a.y : a.y - cy * si->cellSize) / dy : INFINITY;
+	float stepx = dx > 0 ? si->cellSize / dx : INFINITY;
+	float stepy = dy > 0 ? si->cellSize / dy : INFINITY;
+
+	fn(si, cx, cy, h);
+
+	// the step count comes from the end cells, so rounding in t can't
+	//   overshoot them
+	while(n > 0) {
+		if(cy == ey || (cx != ex && tx < ty)) {
+			cx += sx;
+			tx += stepx;
+			n--;
+		}
+		else if(cx == ex || ty < tx) {
+			cy += sy;
+			ty += stepy;
+			n--;
+		}
+		else {
+			fn(si, cx + sx, cy, h);
+			fn(si, cx, cy + sy, h);
+			cx += sx;
+			cy += sy;
+			tx += stepx;
+			ty += stepy;
+			n -= 2;
+		}
+
+		fn(si, cx, cy, h);
+	}
+}
+
+
+static void set_item(SpatialIndex* si, int kind, econid_t id, EcPoint a, EcPoint b) {
+	uint32_t* slot = handle_slot(si, kind, id);
+
+	if(*slot) {
+		uint32_t h = *slot - 1;
+		SpatialItem* it = &VEC_ITEM(&si->items, h);
+
+		// moves inside the same cell don't touch the grid
+		if(it->a.x == it->b.x && it->a.y == it->b.y && a.x == b.x && a.y == b.y
+			&& to_cell(si, it->a.x) == to_cell(si, a.x) && to_cell(si, it->a.y) == to_cell(si, a.y)) {
+			it->a = a;
+			it->b = b;
+			return;
+		}
+
+		walk_item(si, h, unlink_cell);
+		it->a = a;
+		it->b = b;
+		walk_item(si, h, link_cell);
+		return;
+	}
+
+	uint32_t h;
+	if(VEC_LEN(&si->freeItems)) {
+		h = VEC_TAIL(&si->freeItems);
+		VEC_LEN(&si->freeItems)--;
+	}
+	else {
+		h = VEC_LEN(&si->items);
+		VEC_INC(&si->items);
+		VEC_PUSH(&si->stamps, 0);
+	}
+
+	VEC_ITEM(&si->items, h) = (SpatialItem){
+		.id = id,
+		.kind = kind,
+		.live = 1,
+		.a = a,
+		.b = b,
+	};
+
+	*slot = h + 1;
+	si->live[kind]++;
+	walk_item(si, h, link_cell);
+}
+
+
+void Spatial_SetPoint(SpatialIndex* si, econid_t id, EcPoint p) {
+	set_item(si, SPATIAL_ENTITY, id, p, p);
+}
+
+void Spatial_SetSpan(SpatialIndex* si, econid_t id, EcPoint a, EcPoint b) {
+	set_item(si, SPATIAL_ROAD, id, a, b);
+}
+
+
+void Spatial_Remove(SpatialIndex* si, int kind, econid_t id) {
+	if(id >= si->handleAlloc[kind]) return;
+
+	uint32_t* slot = &si->handles[kind][id];
+	if(!*slot) return;
+
+	uint32_t h = *slot - 1;
+	walk_item(si, h, unlink_cell);
+
+	VEC_ITEM(&si->items, h).live = 0;
+	VEC_PUSH(&si->freeItems, h);
+	si->live[kind]--;
+	*slot = 0;
+}
+
+
+
+
+float Spatial_SegmentDist(EcPoint p, EcPoint a, EcPoint b) {
+	float dx = b.x - a.x;
+	float dy = b.y - a.y;
+	float len2 = dx * dx + dy * dy;
+
+	float t = 0;
+	if(len2 > 0) {
+		t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / len2;
+		t = t < 0 ? 0 : (t > 1 ? 1 : t);
+	}
+
+	float ex = a.x + t * dx - p.x;
+	float ey = a.y + t * dy - p.y;
+
+	return sqrtf(ex * ex + ey * ey);
+}
+
+
+static uint32_t next_stamp(SpatialIndex* si) {
+	if(++si->stamp == 0) {
+		memset(VEC_DATA(&si->stamps), 0, sizeof(uint32_t) * VEC_LEN(&si->stamps));
+		si->stamp = 1;
+	}
+
+	return si->stamp;
+}
+
+
+
+
+// appends matches to r when it is given, otherwise fills out up to maxOut
+// returns the total number of matches
+static int query_range(
+	SpatialIndex* si, int kind, EcPoint p, float radius,
+	econid_t* out, float* dists, int maxOut, SpatialResults* r
+) {
+	if(!si->live[kind]) return 0;
+
+	uint32_t stamp = next_stamp(si);
+	int n = 0;
+
+	SpatialBounds* bb = &si->bounds[kind];
+	int32_t x0 = MAX(bb->minCx, to_cell(si, p.x - radius));
+	int32_t x1 = MIN(bb->maxCx, to_cell(si, p.x + radius));
+	int32_t y0 = MAX(bb->minCy, to_cell(si, p.y - radius));
+	int32_t y1 = MIN(bb->maxCy, to_cell(si, p.y + radius));
+
+	for(int32_t cy = y0; cy <= y1; cy++) {
+		for(int32_t cx = x0; cx <= x1; cx++) {
+			SpatialCell* c = find_cell(si, cx, cy);
+			if(!c) continue;
+
+			VEC_EACH(&c->items, i, h) {
+				SpatialItem* it = &VEC_ITEM(&si->items, h);
+				if(it->kind != kind) continue;
+				if(VEC_ITEM(&si->stamps, h) == stamp) continue;
+				VEC_ITEM(&si->stamps, h) = stamp;
+
+				float d = Spatial_SegmentDist(p, it->a, it->b);
+				if(d > radius) continue;
+
+				if(r) {
+					VEC_PUSH(&r->ids, it->id);
+					VEC_PUSH(&r->dists, d);
+				}
+				else if(n < maxOut) {
+					out[n] = it->id;
+					if(dists) dists[n] = d;
+				}
+
+				n++;
+			}
+		}
+	}
+
+	return n;
+}
+
+
+int Spatial_QueryRange(SpatialIndex* si, int kind, EcPoint p, float radius, econid_t* out, float* dists, int maxOut) {
+	return query_range(si, kind, p, radius, out, dists, maxOut, NULL);
+}
+
+
+
+
+static void visit_cell(
+	SpatialIndex* si, int kind, EcPoint p, int32_t cx, int32_t cy,
+	uint32_t stamp, int k, econid_t* out, float* dists, int* found
+) {
+	SpatialCell* c = find_cell(si, cx, cy);
+	if(!c) return;
+
+	VEC_EACH(&c->items, i, h) {
+		SpatialItem* it = &VEC_ITEM(&si->items, h);
+		if(it->kind != kind) continue;
+		if(VEC_ITEM(&si->stamps, h) == stamp) continue;
+		VEC_ITEM(&si->stamps, h) = stamp;
+
+		float d = Spatial_SegmentDist(p, it->a, it->b);
+		if(*found == k && d >= dists[k - 1]) continue;
+
+		// insertion into the sorted top-k
+		int j = *found < k ? (*found)++ : k - 1;
+		for(; j > 0 && dists[j - 1] > d; j--) {
+			dists[j] = dists[j - 1];
+			out[j] = out[j - 1];
+		}
+		dists[j] = d;
+		out[j] = it->id;
+	}
+}
+
+
+// k nearest items, closest first; out and dists must hold k entries
+// returns the number found
+int Spatial_Nearest(SpatialIndex* si, int kind, EcPoint p, int k, econid_t* out, float* dists) {
+	if(!si->live[kind] || k <= 0) return 0;
+
+	uint32_t stamp = next_stamp(si);
+	int found = 0;
+
+	int32_t cx = to_cell(si, p.x);
+	int32_t cy = to_cell(si, p.y);
+
+	// no item of the kind lies beyond its bounds
+	SpatialBounds* bb = &si->bounds[kind];
+	int32_t maxRing = MAX(MAX(cx - bb->minCx, bb->maxCx - cx), MAX(cy - bb->minCy, bb->maxCy - cy));
+
+	for(int32_t ring = 0; ring <= maxRing; ring++) {
+		if(ring == 0) {
+			visit_cell(si, kind, p, cx, cy, stamp, k, out, dists, &found);
+		}
+		else {
+			for(int32_t dx = -ring; dx <= ring; dx++) {
+				visit_cell(si, kind, p, cx + dx, cy - ring, stamp, k, out, dists, &found);
+				visit_cell(si, kind, p, cx + dx, cy + ring, stamp, k, out, dists, &found);
+			}
+			for(int32_t dy = -ring + 1; dy <= ring - 1; dy++) {
+				visit_cell(si, kind, p, cx - ring, cy + dy, stamp, k, out, dists, &found);
+				visit_cell(si, kind, p, cx + ring, cy + dy, stamp, k, out, dists, &found);
+			}
+		}
+
+		// everything outside the rings seen so far is at least this far away
+		if(found == k && dists[k - 1] <= ring * si->cellSize) break;
+	}
+
+	return found;
+}
+
+
+
+
+void SpatialResults_Init(SpatialResults* r) {
+	VEC_INIT(&r->offsets);
+	VEC_INIT(&r->ids);
+	VEC_INIT(&r->dists);
+}
+
+void SpatialResults_Destroy(SpatialResults* r) {
+	VEC_FREE(&r->offsets);
+	VEC_FREE(&r->ids);
+	VEC_FREE(&r->dists);
+}
+
+
+// results are reset, not appended to
+void Spatial_QueryRangeBatch(SpatialIndex* si, int kind, SpatialQuery* qs, long n, SpatialResults* r) {
+	VEC_TRUNC(&r->offsets);
+	VEC_TRUNC(&r->ids);
+	VEC_TRUNC(&r->dists);
+
+	for(long i = 0; i < n; i++) {
+		VEC_PUSH(&r->offsets, VEC_LEN(&r->ids));
+		query_range(si, kind, qs[i].p, qs[i].radius, NULL, NULL, 0, r);
+	}
+
+	VEC_PUSH(&r->offsets, VEC_LEN(&r->ids));
+}
+
+
+void Spatial_NearestBatch(SpatialIndex* si, int kind, SpatialQuery* qs, long n, SpatialResults* r) {
+	VEC_TRUNC(&r->offsets);
+	VEC_TRUNC(&r->ids);
+	VEC_TRUNC(&r->dists);
+
+	for(long i = 0; i < n; i++) {
+		uint32_t off = VEC_LEN(&r->ids);
+		VEC_PUSH(&r->offsets, off);
+
+		// make room for k results, then trim to what was found
+		for(int j = 0; j < qs[i].k; j++) {
+			VEC_PUSH(&r->ids, 0);
+			VEC_PUSH(&r->dists, 0);
+		}
+
+		int found = Spatial_Nearest(si, kind, qs[i].p, qs[i].k, &VEC_ITEM(&r->ids, off), &VEC_ITEM(&r->dists, off));
+		VEC_LEN(&r->ids) = off + found;
+		VEC_LEN(&r->dists) = off + found;
+	}
+
+	VEC_PUSH(&r->offsets, VEC_LEN(&r->ids));
+}
+
+
+
+
+// an entity's own position, or failing that the position of its location
+int Econ_EntityPosition(Economy* ec, Entity* e, EcPoint* out) {
+	EcPoint* p;
+	econid_t* locid;
+	
+	if(ec->positionComp >= 0 && (p = Entity_Get_point(ec, e, ec->positionComp))) {
+		*out = *p;
+		return 1;
+	}
+	
+	if(ec->locationComp >= 0 && (locid = Entity_Get_id(ec, e, ec->locationComp)) && *locid && *locid != e->id) {
+		Entity* loc = Econ_GetEntity(ec, *locid);
+		if(!loc->dead && ec->positionComp >= 0 && (p = Entity_Get_point(ec, loc, ec->positionComp))) {
+			*out = *p;
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+
+// re-indexes one entity after its position, location or road span changed
+void Econ_SpatialUpdate(Economy* ec, Entity* e) {
+	SpatialIndex* si = &ec->spatial;
+	
+	if(e->dead) {
+		Spatial_Remove(si, SPATIAL_ENTITY, e->id);
+		Spatial_Remove(si, SPATIAL_ROAD, e->id);
+		return;
+	}
+	
+	EcPoint p;
+	if(Econ_EntityPosition(ec, e, &p)) Spatial_SetPoint(si, e->id, p);
+	else Spatial_Remove(si, SPATIAL_ENTITY, e->id);
+	
+	VEC_EACHP(&e->comps, i, c) {
+		CompDef* cd = Econ_GetCompDef(ec, c->type);
+		if(!cd || cd->type != CT_roadspan || !c->roadSpan) continue;
+		
+		Spatial_SetSpan(si, e->id, c->roadSpan->a, c->roadSpan->b);
+		return;
+	}
+	
+	Spatial_Remove(si, SPATIAL_ROAD, e->id);
+}
+
+
+void Econ_BuildSpatial(Economy* ec) {
+	ec->positionComp = Econ_CompTypeFromName(ec, "position");
+	ec->locationComp = Econ_CompTypeFromName(ec, "location");
+	
+	// the typed accessors need plain comps of the expected types
+	CompDef* cd;
+	if(ec->positionComp >= 0 && ((cd = Econ_GetCompDef(ec, ec->positionComp))->type != CT_point || cd->isArray)) {
+		LOG("Spatial: 'position' must be a plain point component");
+		ec->positionComp = -1;
+	}
+	if(ec->locationComp >= 0 && ((cd = Econ_GetCompDef(ec, ec->locationComp))->type != CT_id || cd->isArray)) {
+		LOG("Spatial: 'location' must be a plain id component");
+		ec->locationComp = -1;
+	}
+	
+	VECMP_EACH(&ec->entities, i, e) {
+		Econ_SpatialUpdate(ec, e);
+	}
+}
@@ -0,0 +1,100 @@
+#ifndef __econsim_spatial_h__
+#define __econsim_spatial_h__
+
+
+// uniform hash grid over positioned entities and road spans
+
+
+
+enum SpatialKind {
+	SPATIAL_ENTITY = 0,
+	SPATIAL_ROAD,
+	SPATIAL_MAXVALUE,
+};
+
+
+typedef struct SpatialItem {
+	econid_t id;
+	unsigned char kind;
+	unsigned char live;
+	EcPoint a, b; // a point has a == b
+} SpatialItem;
+
+
+typedef struct SpatialBounds {
+	int32_t minCx, minCy, maxCx, maxCy;
+} SpatialBounds;
+
+
+typedef struct SpatialCell {
+	int32_t cx, cy;
+	unsigned char used;
+	VEC(uint32_t) items; // handles
+} SpatialCell;
+
+
+typedef struct SpatialIndex {
+	float cellSize;
+	float invCell;
+
+	// open addressing table of occupied cells
+	SpatialCell* cells;
+	uint32_t cellAlloc;
+	uint32_t cellCnt;
+
+	// per kind: live items, and the cells that have ever held one
+	uint32_t live[SPATIAL_MAXVALUE];
+	SpatialBounds bounds[SPATIAL_MAXVALUE];
+
+	// an item's handle is its index here
+	VEC(SpatialItem) items;
+	VEC(uint32_t) freeItems;
+
+	// entity id -> handle + 1, per kind
+	uint32_t* handles[SPATIAL_MAXVALUE];
+	uint32_t handleAlloc[SPATIAL_MAXVALUE];
+
+	// de-duplicates spans that cover several cells during a query
+	uint32_t stamp;
+	VEC(uint32_t) stamps;
+} SpatialIndex;
+
+
+// results of a batched query: the matches of query i are
+//   ids[offsets[i]] .. ids[offsets[i + 1] - 1]
+typedef struct SpatialResults {
+	VEC(uint32_t) offsets;
+	VEC(econid_t) ids;
+	VEC(float) dists;
+} SpatialResults;
+
+
+typedef struct SpatialQuery {
+	EcPoint p;
+	float radius; // range queries
+	int k; // nearest queries
+} SpatialQuery;
+
+
+
+
+void Spatial_Init(SpatialIndex* si, float cellSize);
+void Spatial_Destroy(SpatialIndex* si);
+
+void Spatial_SetPoint(SpatialIndex* si, econid_t id, EcPoint p);
+void Spatial_SetSpan(SpatialIndex* si, econid_t id, EcPoint a, EcPoint b);
+void Spatial_Remove(SpatialIndex* si, int kind, econid_t id);
+
+int Spatial_QueryRange(SpatialIndex* si, int kind, EcPoint p, float radius, econid_t* out, float* dists, int maxOut);
+int Spatial_Nearest(SpatialIndex* si, int kind, EcPoint p, int k, econid_t* out, float* dists);
+
+void SpatialResults_Init(SpatialResults* r);
+void SpatialResults_Destroy(SpatialResults* r);
+void Spatial_QueryRangeBatch(SpatialIndex* si, int kind, SpatialQuery* qs, long n, SpatialResults* r);
+void Spatial_NearestBatch(SpatialIndex* si, int kind, SpatialQuery* qs, long n, SpatialResults* r);
+
+float Spatial_SegmentDist(EcPoint p, EcPoint a, EcPoint b);
+
+
+
+#endif // __econsim_spatial_h__
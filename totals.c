@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "econ.h"
+
+
+
+
+void Totals_Init(CommodityTotals* ct, ItemTable* index) {
+	memset(ct, 0, sizeof(*ct));
+	ct->index = index;
+	VEC_INIT(&ct->items);
+}
+
+
+void Totals_Destroy(CommodityTotals* ct) {
+	free(ct->t);
+	free(ct->seen);
+	VEC_FREE(&ct->items);
+}
+
+
+void Totals_Clear(CommodityTotals* ct) {
+	if(ct->alloc) {
+		memset(ct->t, 0, sizeof(*ct->t) * ct->alloc);
+		memset(ct->seen, 0, sizeof(*ct->seen) * ct->alloc);
+	}
+	VEC_TRUNC(&ct->items);
+}
+
+
+// slow path of Totals_Delta: makes room for the item and starts tracking it
+// returns the item's row
+itemidx_t Totals_Track(CommodityTotals* ct, econid_t item) {
+	itemidx_t x = Items_Assert(ct->index, item);
+	
+	if(x >= ct->alloc) {
+		itemidx_t n = MAX(256, ct->alloc);
+		while(n <= x) n *= 2;
+		
+		ct->t = realloc(ct->t, sizeof(*ct->t) * n);
+		ct->seen = realloc(ct->seen, sizeof(*ct->seen) * n);
+		memset(ct->t + ct->alloc, 0, sizeof(*ct->t) * (n - ct->alloc));
+		memset(ct->seen + ct->alloc, 0, sizeof(*ct->seen) * (n - ct->alloc));
+		
+		ct->alloc = n;
+	}
+	
+	if(!ct->seen[x]) {
+		ct->seen[x] = 1;
+		VEC_PUSH(&ct->items, item);
+	}
+	
+	return x;
+}
+
+
+
+
+// counts every inventory and shipment from scratch, and hooks the
+//   inventories up so they keep the totals current from here on
+// whatever already exists is taken to have been created
+void Econ_BuildTotals(Economy* ec) {
+	CommodityTotals* ct = &ec->totals;
+	Totals_Clear(ct);
+	
+	for(invid_t h = 1; h < VECMP_LEN(&ec->invs.slots); h++) {
+		InvSlot* s = InvTable_Slot(&ec->invs, h);
+		if(!VEC_LEN(&s->owners)) continue;
+		
+		Inventory* inv = &s->inv;
+		inv->totals = ct;
+		
+		VECMP_EACH(&inv->items, j, it) {
+			Totals_Delta(ct, it->item, TOT_INV, it->count);
+			Totals_Delta(ct, it->item, TOT_CREATED, it->count);
+		}
+		VEC_EACHP(&inv->escrow, j, es) {
+			Totals_Delta(ct, es->item, TOT_ESCROW, es->count);
+			Totals_Delta(ct, es->item, TOT_CREATED, es->count);
+		}
+	}
+	
+	for(int b = 0; b < SHIP_RING_SIZE; b++) {
+		VEC_EACHP(&ec->ships.ring[b], j, s) {
+			Totals_Delta(ct, s->item, TOT_TRANSIT, s->qty);
+			Totals_Delta(ct, s->item, TOT_CREATED, s->qty);
+		}
+	}
+	VEC_EACHP(&ec->ships.far, j, s) {
+		Totals_Delta(ct, s->item, TOT_TRANSIT, s->qty);
+		Totals_Delta(ct, s->item, TOT_CREATED, s->qty);
+	}
+}
+
+
+// returns the number of items whose totals don't add up
+int Econ_CheckTotals(Economy* ec) {
+	CommodityTotals* ct = &ec->totals;
+	int bad = 0;
+	
+	VEC_EACH(&ct->items, i, item) {
+		int64_t* t = ct->t[Items_Index(ct->index, item)];
+		
+		int64_t held = t[TOT_INV] + t[TOT_ESCROW] + t[TOT_TRANSIT] + t[TOT_CONSUMED];
+		if(held == t[TOT_CREATED] - t[TOT_DESTROYED] && t[TOT_INV] >= 0 && t[TOT_ESCROW] >= 0 && t[TOT_TRANSIT] >= 0) {
+			continue;
+		}
+		
+		LOG("tick %u: item %u totals out of balance: inv %ld escrow %ld transit %ld consumed %ld created %ld destroyed %ld",
+			ec->tick, item, (long)t[TOT_INV], (long)t[TOT_ESCROW], (long)t[TOT_TRANSIT], (long)t[TOT_CONSUMED],
+			(long)t[TOT_CREATED], (long)t[TOT_DESTROYED]);
+		bad++;
+	}
+	
+	return bad;
+}
+
@@ -0,0 +1,60 @@
+
+
+// world totals of every item, kept current through Totals_Delta calls
+//   from the inventory, conversion, market and shipping code
+
+
+
+enum TotalsBucket {
+	TOT_INV = 0,
+	TOT_ESCROW,
+	TOT_TRANSIT,
+	TOT_CONSUMED, // bought by market sinks
+	
+	// flows in and out of existence; the buckets above always add up to
+	//   created - destroyed
+	TOT_CREATED,
+	TOT_DESTROYED,
+	
+	TOT_MAXVALUE,
+};
+
+
+typedef struct CommodityTotals {
+	ItemTable* index; // item ids to rows
+	itemidx_t alloc;
+	int64_t (*t)[TOT_MAXVALUE]; // by dense item index
+	unsigned char* seen;
+	
+	// every item that has ever had a total, for O(items) walks
+	VEC(econid_t) items;
+} CommodityTotals;
+
+
+
+
+void Totals_Init(CommodityTotals* ct, ItemTable* index);
+void Totals_Destroy(CommodityTotals* ct);
+void Totals_Clear(CommodityTotals* ct);
+itemidx_t Totals_Track(CommodityTotals* ct, econid_t item);
+
+
+static inline void Totals_Delta(CommodityTotals* ct, econid_t item, int bucket, long delta) {
+	if(!ct || !delta) return;
+	
+	itemidx_t x = Items_Index(ct->index, item);
+	if(x >= ct->alloc || !ct->seen[x]) x = Totals_Track(ct, item);
+	
+	ct->t[x][bucket] += delta;
+}
+
+static inline int64_t Totals_Get(CommodityTotals* ct, econid_t item, int bucket) {
+	itemidx_t x = Items_Index(ct->index, item);
+	return x < ct->alloc ? ct->t[x][bucket] : 0;
+}
+
+
+struct Economy;
+void Econ_BuildTotals(struct Economy* ec);
+int Econ_CheckTotals(struct Economy* ec);
+
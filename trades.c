@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "econ.h"
+
+
+
+
+// capacity is rounded up to a power of two, and clamped to TRADES_MAXCAP
+void Trades_Init(TradeTape* tt, ItemTable* index, long capacity, int barTicks) {
+	memset(tt, 0, sizeof(*tt));
+	tt->index = index;
+	
+	capacity = MIN(capacity, TRADES_MAXCAP);
+	
+	uint32_t n = 64;
+	while(n < capacity) n *= 2;
+	
+	tt->ring = calloc(1, sizeof(*tt->ring) * n);
+	tt->mask = n - 1;
+	tt->barTicks = MAX(1, barTicks);
+	
+	VEC_INIT(&tt->items);
+}
+
+
+void Trades_Destroy(TradeTape* tt) {
+	VEC_EACH(&tt->items, i, s) {
+		free(s);
+	}
+	VEC_FREE(&tt->items);
+	free(tt->stats);
+	free(tt->ring);
+}
+
+
+
+static ItemTradeStats* get_stats(TradeTape* tt, econid_t item) {
+	ItemTradeStats* s = Trades_Stats(tt, item);
+	if(s) return s;
+	
+	itemidx_t x = Items_Assert(tt->index, item);
+	
+	if(x >= tt->statsAlloc) {
+		itemidx_t n = MAX(256, tt->statsAlloc);
+		while(n <= x) n *= 2;
+		
+		tt->stats = realloc(tt->stats, sizeof(*tt->stats) * n);
+		memset(tt->stats + tt->statsAlloc, 0, sizeof(*tt->stats) * (n - tt->statsAlloc));
+		tt->statsAlloc = n;
+	}
+	
+	s = calloc(1, sizeof(*s));
+	s->item = item;
+	
+	tt->stats[x] = s;
+	VEC_PUSH(&tt->items, s);
+	
+	return s;
+}
+
+
+// price is the total paid for qty
+void Trades_Record(TradeTape* tt, tick_t tick, econid_t item, econid_t buyer, econid_t seller, long qty, money_t price) {
+	if(qty <= 0) return;
+	
+	tt->ring[tt->count & tt->mask] = (TradeRec){
+		.tick = tick,
+		.item = item,
+		.buyer = buyer,
+		.seller = seller,
+		.qty = qty,
+		.price = price,
+	};
+	tt->count++;
+	
+	ItemTradeStats* s = get_stats(tt, item);
+	money_t unit = price / qty;
+	
+	s->lastTick = tick;
+	s->last = unit;
+	s->volume += qty;
+	s->value += price;
+	
+	// bars are aligned to multiples of barTicks; ticks with no trades get no bar
+	tick_t start = tick - tick % tt->barTicks;
+	TradeBar* b = &s->bars[(s->barCnt - 1) % TRADE_BARS];
+	
+	if(!s->barCnt || b->start != start) {
+		b = &s->bars[s->barCnt++ % TRADE_BARS];
+		*b = (TradeBar){
+			.start = start,
+			.open = unit,
+			.high = unit,
+			.low = unit,
+		};
+	}
+	
+	b->high = MAX(b->high, unit);
+	b->low = MIN(b->low, unit);
+	b->close = unit;
+	b->volume += qty;
+	b->value += price;
+}
+
+
+
+// back 0 is the newest trade; NULL once it has been overwritten
+TradeRec* Trades_Get(TradeTape* tt, uint64_t back) {
+	if(back >= tt->count || back > tt->mask) return NULL;
+	return &tt->ring[(tt->count - 1 - back) & tt->mask];
+}
+
+
+// NULL if the item has never traded
+ItemTradeStats* Trades_Stats(TradeTape* tt, econid_t item) {
+	itemidx_t x = Items_Index(tt->index, item);
+	return x < tt->statsAlloc ? tt->stats[x] : NULL;
+}
+
+
+// back 0 is the newest bar, which may still be open
+TradeBar* Trades_Bar(TradeTape* tt, econid_t item, uint32_t back) {
+	ItemTradeStats* s = Trades_Stats(tt, item);
+	if(!s || back >= s->barCnt || back >= TRADE_BARS) return NULL;
+	
+	return &s->bars[(s->barCnt - 1 - back) % TRADE_BARS];
+}
+
+
+// unit price weighted by volume over the newest bars, or the whole run for 0
+// returns 0 if nothing traded
+money_t Trades_VWAP(TradeTape* tt, econid_t item, uint32_t bars) {
+	ItemTradeStats* s = Trades_Stats(tt, item);
+	if(!s) return 0;
+	
+	if(!bars) return s->volume ? s->value / s->volume : 0;
+	
+	long volume = 0;
+	money_t value = 0;
+	for(uint32_t i = 0; i < bars; i++) {
+		TradeBar* b = Trades_Bar(tt, item, i);
+		if(!b) break;
+		
+		volume += b->volume;
+		value += b->value;
+	}
+	
+	return volume ? value / volume : 0;
+}
+
+
+
+
+// copies this tick's fills from every market onto the tape
+// must run before the fills are turned into shipments
+void Econ_RecordTrades(Economy* ec) {
+	VEC_EACH(&ec->markets, mi, m) {
+		VEC_EACHP(&m->fills, i, f) {
+			Trades_Record(&ec->trades, ec->tick, f->item, f->buyer, f->seller, f->qty, f->price);
+		}
+	}
+}
@@ -0,0 +1,75 @@
+
+
+
+// every market fill, in a fixed ring of recent trades, plus running
+//   per-item price statistics that never need the history rescanned
+
+
+
+// the ring never grows past this many trades
+#define TRADES_MAXCAP (1l << 26)
+
+typedef struct TradeRec {
+	tick_t tick;
+	econid_t item;
+	econid_t buyer, seller;
+	int64_t qty;
+	money_t price; // total paid
+} TradeRec;
+
+
+// prices are per unit
+typedef struct TradeBar {
+	tick_t start;
+	money_t open, high, low, close;
+	long volume;
+	money_t value; // total paid, for the bar's vwap
+} TradeBar;
+
+
+// must be a power of two
+#define TRADE_BARS 64
+
+typedef struct ItemTradeStats {
+	econid_t item;
+	tick_t lastTick;
+	money_t last; // unit price of the latest fill
+	
+	// since the start of the run
+	long volume;
+	money_t value;
+	
+	// the most recent bars; bar n is in bars[n % TRADE_BARS]
+	uint32_t barCnt;
+	TradeBar bars[TRADE_BARS];
+} ItemTradeStats;
+
+
+typedef struct TradeTape {
+	TradeRec* ring;
+	uint32_t mask; // ring size - 1
+	uint64_t count; // trades ever recorded
+	
+	int barTicks; // length of an ohlc bar
+	
+	ItemTable* index; // item ids to rows
+	ItemTradeStats** stats; // by dense item index
+	itemidx_t statsAlloc;
+	VEC(ItemTradeStats*) items;
+} TradeTape;
+
+
+
+
+void Trades_Init(TradeTape* tt, ItemTable* index, long capacity, int barTicks);
+void Trades_Destroy(TradeTape* tt);
+
+void Trades_Record(TradeTape* tt, tick_t tick, econid_t item, econid_t buyer, econid_t seller, long qty, money_t price);
+
+TradeRec* Trades_Get(TradeTape* tt, uint64_t back);
+ItemTradeStats* Trades_Stats(TradeTape* tt, econid_t item);
+TradeBar* Trades_Bar(TradeTape* tt, econid_t item, uint32_t back);
+money_t Trades_VWAP(TradeTape* tt, econid_t item, uint32_t bars);
+
+struct Economy;
+void Econ_RecordTrades(struct Economy* ec);
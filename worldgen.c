@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "worldgen.h"
+
+
+
+
+typedef struct Rng {
+	uint64_t s;
+} Rng;
+
+// splitmix64; identical output on every platform for a given seed
+static uint64_t rng_next(Rng* r) {
+	uint64_t z = (r->s += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static long rng_range(Rng* r, long min, long max) {
+	if(max <= min) return min;
+	return min + (long)(rng_next(r) % (uint64_t)(max - min + 1));
+}
+
+static double rng_float(Rng* r, double min, double max) {
+	return min + (rng_next(r) >> 11) * (1.0 / 9007199254740992.0) * (max - min);
+}
+
+
+
+void WorldGen_DefaultOpts(WorldGenOpts* o) {
+	memset(o, 0, sizeof(*o));
+
+	o->seed = 1;
+	o->forests = 10;
+	o->camps = 20;
+	o->sinks = 2;
+	o->mines = 4;
+	o->people = 50;
+	o->minPrice = 2;
+	o->maxPrice = 12;
+}
+
+
+
+
+static char* item_name(Economy* ec, econid_t id) {
+	Comp* c = Entity_GetCompName(ec, Econ_GetEntity(ec, id), "name");
+	return c && c->str ? c->str : "";
+}
+
+
+static int conv_has_input(Economy* ec, econid_t item) {
+	VECMP_EACH(&ec->conversions, i, cv) {
+		for(int n = 0; n < cv->inputCnt; n++) {
+			if(cv->inputs[n].item == item) return 1;
+		}
+	}
+	return 0;
+}
+
+static int conv_has_output(Economy* ec, econid_t item) {
+	VECMP_EACH(&ec->conversions, i, cv) {
+		for(int n = 0; n < cv->outputCnt; n++) {
+			if(cv->outputs[n].item == item) return 1;
+		}
+	}
+	return 0;
+}
+
+
+
+static void write_defs(Economy* ec, FILE* f) {
+
+	fprintf(f, "component_defs: [\n");
+	VECMP_EACH(&ec->compDefs, i, cd) {
+		fprintf(f, "\t{name: \"%s\", type: \"%s%s\"",
+			cd->name, cd->isArray ? "^" : "", CompInternalType_GetName(cd->type));
+		
+		if(cd->hasDefault && cd->isArray) {
+			// a plain number reads back as an empty array
+			int n;
+			void* p = Comp_Data(ec, cd->def, &n);
+			if(n && (cd->type == CT_int || cd->type == CT_float)) {
+				fprintf(f, ", default: [");
+				for(int k = 0; k < n; k++) {
+					if(cd->type == CT_int) fprintf(f, "%s%ld", k ? ", " : "", ((int64_t*)p)[k]);
+					else fprintf(f, "%s%f", k ? ", " : "", ((double*)p)[k]);
+				}
+				fprintf(f, "]");
+			}
+			else fprintf(f, ", default: 0");
+		}
+		else if(cd->hasDefault) {
+			if(cd->type == CT_int) fprintf(f, ", default: %ld", cd->def->n);
+			else if(cd->type == CT_float) fprintf(f, ", default: %f", cd->def->d);
+		}
+		
+		fprintf(f, "},\n");
+	}
+	fprintf(f, "],\n");
+
+
+	fprintf(f, "entity_defs: [\n");
+	VECMP_EACH(&ec->entityDefs, i, ed) {
+		fprintf(f, "\t{name: \"%s\"", ed->name);
+		if(ed->fusedInv) {
+			fprintf(f, ", fusedInv: \"%s\"", Econ_GetCompDef(ec, ed->fusedInv)->name);
+		}
+		
+		fprintf(f, ", defaultComps: [");
+		VEC_EACHP(&ed->defaultComps, j, dc) {
+			fprintf(f, "\"%s\", ", Econ_GetCompDef(ec, dc->defID)->name);
+		}
+		fprintf(f, "]},\n");
+	}
+	fprintf(f, "],\n");
+
+
+	fprintf(f, "conversions: [\n");
+	VECMP_EACH(&ec->conversions, i, cv) {
+		fprintf(f, "\t{id: \">c%u\", name: \"%s\", input: [", cv->id, cv->name ? cv->name : "");
+		for(int n = 0; n < cv->inputCnt; n++) {
+			fprintf(f, "[\"@i%u\", %ld], ", cv->inputs[n].item, cv->inputs[n].count);
+		}
+		fprintf(f, "], output: [");
+		for(int n = 0; n < cv->outputCnt; n++) {
+			fprintf(f, "[\"@i%u\", %ld], ", cv->outputs[n].item, cv->outputs[n].count);
+		}
+		fprintf(f, "]},\n");
+	}
+	fprintf(f, "],\n");
+}
+
+
+
+
+int WorldGen_Write(Economy* ec, WorldGenOpts* o, FILE* f) {
+	Rng rng = {o->seed};
+
+	int itemType = Economy_EntityType(ec, "Item");
+	int mineType = Economy_EntityType(ec, "Mine");
+	int forestType = Economy_EntityType(ec, "Forest");
+	int campType = Economy_EntityType(ec, "LoggingCamp");
+	int personType = Economy_EntityType(ec, "Person");
+
+	EntityDef* itemDef = Economy_GetEntityDef(ec, itemType);
+	if(!itemDef) {
+		LOG("WorldGen: template has no Item type");
+		return 1;
+	}
+
+	// classify the template's items by where they sit in the conversion chains
+	VEC(econid_t) raws;
+	VEC(econid_t) finals;
+	VEC(econid_t) mined;
+	VEC(Conversion*) convs;
+	VEC_INIT(&raws);
+	VEC_INIT(&finals);
+	VEC_INIT(&mined);
+	VEC_INIT(&convs);
+
+	VEC_EACH(&itemDef->instances, i, iid) {
+		if(conv_has_input(ec, iid) && !conv_has_output(ec, iid)) VEC_PUSH(&raws, iid);
+	}
+
+	// the main product of the last stage in a chain is what gets sold;
+	//   byproducts are left to pile up
+	VECMP_EACH(&ec->conversions, i, cv) {
+		VEC_PUSH(&convs, cv);
+
+		econid_t out = cv->outputs[0].item;
+		if(!conv_has_input(ec, out)) VEC_PUSH(&finals, out);
+	}
+
+	EntityDef* mineDef = Economy_GetEntityDef(ec, mineType);
+	if(mineDef) {
+		int prodtype = Econ_CompTypeFromName(ec, "produces");
+		VEC_EACH(&mineDef->instances, i, mid) {
+			int n;
+			ItemRate* ir = Entity_Elems_itemRate(ec, Econ_GetEntity(ec, mid), prodtype, &n);
+			for(int k = 0; k < n; k++) {
+				if(ir[k].item) VEC_PUSH(&mined, ir[k].item);
+			}
+		}
+	}
+
+
+	fprintf(f, "{\n");
+	write_defs(ec, f);
+
+
+	// markets get a sink per requested slot, each wanting a final product
+	fprintf(f, "market: {\n\tsinks: [\n");
+	for(long i = 0; VEC_LEN(&finals) && i < o->sinks; i++) {
+		econid_t item = VEC_ITEM(&finals, rng_range(&rng, 0, VEC_LEN(&finals) - 1));
+		fprintf(f, "\t\t{name: \"Sink %ld\", item: \"@i%u\", maxBuyPrice: %ld, maxBuysPerTick: %ld},\n",
+			i, item, rng_range(&rng, (o->minPrice + o->maxPrice) / 2, o->maxPrice), rng_range(&rng, 10, 500)
+		);
+	}
+	fprintf(f, "\t],\n},\n");
+
+
+	fprintf(f, "entities: [\n");
+
+	VEC_EACH(&itemDef->instances, i, iid) {
+		Entity* e = Econ_GetEntity(ec, iid);
+		Comp* w = Entity_GetCompName(ec, e, "weight");
+		Comp* v = Entity_GetCompName(ec, e, "volume");
+
+		fprintf(f, "\t{id: \"@i%u\", type: \"Item\", comps: [[\"name\", \"%s\"], [\"weight\", %f], [\"volume\", %f]]},\n",
+			iid, item_name(ec, iid), w ? w->d : 0.0, v ? v->d : 0.0
+		);
+	}
+
+
+	// forests hold the raw materials
+	if(forestType >= 0) {
+		for(long i = 0; i < o->forests; i++) {
+			fprintf(f, "\t{id: \"@f%ld\", type: \"Forest\", comps: [[\"name\", \"Forest %ld\"], [\"acres\", %ld]], inv: [",
+				i, i, rng_range(&rng, 20, 200)
+			);
+			VEC_EACH(&raws, j, rid) {
+				fprintf(f, "[\"@i%u\", %ld], ", rid, rng_range(&rng, 1000, 20000));
+			}
+			fprintf(f, "]},\n");
+		}
+	}
+
+
+	// camps are spread so every forest gets each stage of the chain in turn
+	if(campType >= 0 && o->forests > 0 && VEC_LEN(&convs)) {
+		for(long i = 0; i < o->camps; i++) {
+			Conversion* cv = VEC_ITEM(&convs, i % VEC_LEN(&convs));
+			long forest = (i / VEC_LEN(&convs)) % o->forests;
+
+			fprintf(f, "\t{type: \"LoggingCamp\", comps: [[\"name\", \"Camp %ld\"], [\"converts\", [%f, \">c%u\"]], [\"location\", \"@f%ld\"]",
+				i, rng_float(&rng, 0.5, 5.0), cv->id, forest
+			);
+
+			econid_t out = cv->outputs[0].item;
+			VEC_EACH(&finals, j, fid) {
+				if(fid != out) continue;
+				fprintf(f, ", [\"sells\", [\"@i%u\", %ld]]", out, rng_range(&rng, o->minPrice, o->maxPrice));
+				break;
+			}
+
+			fprintf(f, "]},\n");
+		}
+	}
+
+
+	if(mineType >= 0 && VEC_LEN(&mined)) {
+		for(long i = 0; i < o->mines; i++) {
+			econid_t item = VEC_ITEM(&mined, rng_range(&rng, 0, VEC_LEN(&mined) - 1));
+			fprintf(f, "\t{type: \"Mine\", comps: [[\"name\", \"Mine %ld\"], [\"produces\", [\"@i%u\", %f]]]},\n",
+				i, item, rng_float(&rng, 0.1, 3.0)
+			);
+		}
+	}
+
+
+	if(personType >= 0) {
+		for(long i = 0; i < o->people; i++) {
+			fprintf(f, "\t{type: \"Person\", comps: [[\"name\", \"Person %ld\"], [\"cash\", %ld]]},\n",
+				i, rng_range(&rng, 0, 100000)
+			);
+		}
+	}
+
+	fprintf(f, "],\n}\n");
+
+
+	VEC_FREE(&raws);
+	VEC_FREE(&finals);
+	VEC_FREE(&mined);
+	VEC_FREE(&convs);
+
+	return 0;
+}
+
+
+int WorldGen_WritePath(Economy* tmpl, WorldGenOpts* o, char* path) {
+	FILE* f = fopen(path, "w");
+	if(!f) {
+		LOG("WorldGen: could not open '%s'", path);
+		return 1;
+	}
+
+	int ret = WorldGen_Write(tmpl, o, f);
+
+	fclose(f);
+
+	return ret;
+}
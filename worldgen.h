@@ -0,0 +1,34 @@
+#ifndef __econsim_worldgen_h__
+#define __econsim_worldgen_h__
+
+
+#include "econ.h"
+
+
+
+typedef struct WorldGenOpts {
+	uint64_t seed;
+
+	long forests;
+	long camps;
+	long sinks;
+	long mines;
+	long people;
+
+	// range for sell prices; sinks bid somewhere around it
+	money_t minPrice, maxPrice;
+
+} WorldGenOpts;
+
+
+
+void WorldGen_DefaultOpts(WorldGenOpts* o);
+
+// writes a complete world file, readable by Economy_LoadConfig, using the
+//   component defs, entity defs, items and conversions in tmpl as templates
+int WorldGen_Write(Economy* tmpl, WorldGenOpts* o, FILE* f);
+int WorldGen_WritePath(Economy* tmpl, WorldGenOpts* o, char* path);
+
+
+
+#endif // __econsim_worldgen_h__